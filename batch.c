@@ -0,0 +1,389 @@
+// batch.c
+#include "batch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// A point travelling down the tree, with the index of the operation it belongs to
+typedef struct BatchItem {
+    uint64_t key;
+    Point point;
+    int op;
+} BatchItem;
+
+// Work for one subtree: its node and the items routed to it
+typedef struct BatchWork {
+    OctreeNode *node;
+    BatchItem *items;
+    BatchItem *scratch;
+    int count;
+    BatchOp *ops;
+    unsigned long version;
+    bool parallel;
+} BatchWork;
+
+// Spread the low MORTON_BITS bits of v two bits apart
+static uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// Quantize a coordinate to MORTON_BITS within the root cube
+static uint64_t mortonAxis(float v, float center, float size) {
+    double t = (v - (center - size)) / (2.0 * size);
+    if (t < 0.0) t = 0.0;
+    uint64_t q = (uint64_t)(t * (1u << MORTON_BITS));
+    return q >= (1u << MORTON_BITS) ? (1u << MORTON_BITS) - 1 : q;
+}
+
+// Morton key of a point, with x, y and z bits interleaved in the same order as getOctant()
+uint64_t mortonKey(OctreeNode *root, Point *p) {
+    return spreadBits(mortonAxis(p->x, root->center.x, root->size)) << 2 |
+           spreadBits(mortonAxis(p->y, root->center.y, root->size)) << 1 |
+           spreadBits(mortonAxis(p->z, root->center.z, root->size));
+}
+
+// Stable LSD radix sort by Morton key, 11 bits per pass; scratch must hold count items
+static void sortItems(BatchItem *items, BatchItem *scratch, int count) {
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += 11) {
+        int buckets[2048] = {0};
+        for (int i = 0; i < count; i++) buckets[(items[i].key >> shift) & 2047]++;
+        int sum = 0;
+        for (int b = 0; b < 2048; b++) {
+            int size = buckets[b];
+            buckets[b] = sum;
+            sum += size;
+        }
+        for (int i = 0; i < count; i++) scratch[buckets[(items[i].key >> shift) & 2047]++] = items[i];
+        BatchItem *swap = items;
+        items = scratch;
+        scratch = swap;
+    }
+    // An even number of passes leaves the result in items
+}
+
+// Record the outcome of an item's operation
+static void setStatus(BatchWork *work, BatchItem *item, BatchStatus status) {
+    work->ops[item->op].status = status;
+}
+
+static bool samePoint(Point *p, Point *q) {
+    return p->x == q->x && p->y == q->y && p->z == q->z;
+}
+
+// Split items by child octant, keeping their order; offsets and sizes receive each child's range.
+// Morton order already groups items by octant, so they are only moved when rounding at a
+// cell boundary put one out of place.
+static void partitionItems(OctreeNode *node, BatchItem *items, BatchItem *scratch, int count, int offsets[8], int sizes[8]) {
+    memset(sizes, 0, 8 * sizeof(int));
+    bool grouped = true;
+    int last = 0;
+    for (int i = 0; i < count; i++) {
+        int octant = getOctant(&node->center, &items[i].point);
+        if (octant < last) grouped = false;
+        last = octant;
+        sizes[octant]++;
+    }
+    offsets[0] = 0;
+    for (int o = 1; o < 8; o++) offsets[o] = offsets[o - 1] + sizes[o - 1];
+    if (grouped) return;
+
+    int fill[8];
+    memcpy(fill, offsets, sizeof(fill));
+    for (int i = 0; i < count; i++) scratch[fill[getOctant(&node->center, &items[i].point)]++] = items[i];
+    memcpy(items, scratch, count * sizeof(BatchItem));
+}
+
+static void *deleteWork(void *arg);
+static void *insertWork(void *arg);
+
+// Run fn on every child that received items, on separate threads when work->parallel is set
+static void forEachChild(BatchWork *work, void *(*fn)(void *)) {
+    int offsets[8], sizes[8];
+    partitionItems(work->node, work->items, work->scratch, work->count, offsets, sizes);
+
+    BatchWork children[8];
+    pthread_t threads[8];
+    bool started[8] = {false};
+    for (int o = 0; o < 8; o++) {
+        if (sizes[o] == 0) continue;
+        children[o] = *work;
+        children[o].node = work->node->children[o];
+        children[o].items = work->items + offsets[o];
+        children[o].scratch = work->scratch + offsets[o];
+        children[o].count = sizes[o];
+        children[o].parallel = false;
+        if (work->parallel && pthread_create(&threads[o], NULL, fn, &children[o]) == 0) {
+            started[o] = true;
+        } else {
+            fn(&children[o]);
+        }
+    }
+    for (int o = 0; o < 8; o++) {
+        if (started[o]) pthread_join(threads[o], NULL);
+    }
+}
+
+// Merge the children into node once, under the same condition as deletePoint()
+static void mergeChildren(OctreeNode *node) {
+    int totalPoints = 0;
+    for (int i = 0; i < 8; i++) {
+        if (node->children[i] != NULL) {
+            if (!node->children[i]->isLeaf) return;
+            totalPoints += node->children[i]->ptCount;
+        }
+    }
+    if (totalPoints > MAX_POINTS) return;
+
+    int count = 0;
+    for (int i = 0; i < 8; i++) {
+        if (node->children[i] != NULL) {
+            for (int j = 0; j < node->children[i]->ptCount; j++) {
+                node->points[count++] = node->children[i]->points[j];
+            }
+            releaseNode(node->children[i]);
+            node->children[i] = NULL;
+        }
+    }
+    node->ptCount = count;
+    node->isLeaf = 1;
+}
+
+// Delete the items' points from a subtree, merging each node at most once
+static void *deleteWork(void *arg) {
+    BatchWork *work = (BatchWork *)arg;
+    OctreeNode *node = work->node;
+    node->version = work->version;
+
+    if (node->isLeaf) {
+        for (int i = 0; i < work->count; i++) {
+            BatchItem *item = &work->items[i];
+            int found = -1;
+            for (int j = 0; j < node->ptCount; j++) {
+                if (samePoint(&node->points[j], &item->point)) {
+                    found = j;
+                    break;
+                }
+            }
+            if (found == -1) {
+                setStatus(work, item, BATCH_NOT_FOUND);
+                continue;
+            }
+            for (int j = found; j < node->ptCount - 1; j++) {
+                node->points[j] = node->points[j + 1];
+            }
+            node->ptCount--;
+            setStatus(work, item, BATCH_DONE);
+        }
+        return NULL;
+    }
+
+    forEachChild(work, deleteWork);
+    mergeChildren(node);
+    return NULL;
+}
+
+// Insert the items' points into a subtree, subdividing each node at most once
+static void *insertWork(void *arg) {
+    BatchWork *work = (BatchWork *)arg;
+    OctreeNode *node = work->node;
+    node->version = work->version;
+
+    if (node->isLeaf) {
+        // Drop points already stored in this leaf
+        int n = 0;
+        for (int i = 0; i < work->count; i++) {
+            BatchItem *item = &work->items[i];
+            bool duplicate = false;
+            for (int j = 0; j < node->ptCount; j++) {
+                if (samePoint(&node->points[j], &item->point)) duplicate = true;
+            }
+            if (duplicate) {
+                setStatus(work, item, BATCH_DUPLICATE);
+            } else {
+                work->items[n++] = *item;
+            }
+        }
+        if (n == 0) return NULL;
+
+        if (node->ptCount + n <= MAX_POINTS || node->depth == MAX_DEPTH) {
+            for (int i = 0; i < n; i++) {
+                BatchItem *item = &work->items[i];
+                if (node->ptCount < MAX_POINTS) {
+                    node->points[node->ptCount++] = item->point;
+                    setStatus(work, item, BATCH_DONE);
+                } else {
+                    setStatus(work, item, BATCH_FAILED);
+                }
+            }
+            return NULL;
+        }
+
+        // Subdivide once; the stored points go down ahead of the new ones, as in insertPoint().
+        // They fit into the empty children without further subdivision.
+        subdivideNode(node);
+        for (int j = 0; j < node->ptCount; j++) {
+            int octant = getOctant(&node->center, &node->points[j]);
+            insertPoint_collision(node->children[octant], &node->points[j]);
+        }
+        node->ptCount = 0;
+        work->count = n;
+    }
+
+    forEachChild(work, insertWork);
+    return NULL;
+}
+
+// Gather the items of the given operations, sorted by Morton key
+static BatchItem *collectItems(OctreeNode *root, BatchOp *ops, int count, bool deletes, int *n) {
+    BatchItem *items = (BatchItem *)malloc(2 * (count > 0 ? count : 1) * sizeof(BatchItem));
+    if (!items) {
+        perror("Failed to allocate memory for batch");
+        exit(EXIT_FAILURE);
+    }
+    *n = 0;
+    for (int i = 0; i < count; i++) {
+        BatchOp *op = &ops[i];
+        Point *p;
+        if (deletes) {
+            if (op->type == BATCH_INSERT) continue;
+            p = &op->point;
+        } else if (op->type == BATCH_INSERT) {
+            p = &op->point;
+        } else if (op->type == BATCH_MOVE && op->status == BATCH_DONE) {
+            p = &op->newPoint;
+        } else {
+            continue;
+        }
+        items[*n].key = mortonKey(root, p);
+        items[*n].point = *p;
+        items[*n].op = i;
+        (*n)++;
+    }
+    sortItems(items, items + *n, *n);
+    return items;
+}
+
+// Apply one merged pass over the tree for the collected items
+static void runPass(OctreeNode *root, BatchItem *items, int n, BatchOp *ops, void *(*fn)(void *)) {
+    if (n == 0) return;
+    BatchWork work = { root, items, items + n, n, ops, nextVersion(), n >= BATCH_PARALLEL_MIN };
+    fn(&work);
+}
+
+// Point an operation added to the tree, NULL if it added none
+static Point *addedPoint(BatchOp *op) {
+    if (op->status != BATCH_DONE) return NULL;
+    if (op->type == BATCH_INSERT) return &op->point;
+    if (op->type == BATCH_MOVE) return &op->newPoint;
+    return NULL;
+}
+
+// The MAX_DEPTH leaf of p is full, so undo the latest operation of the batch that added
+// a point to it: before the batch that leaf's cell held at most MAX_POINTS points, all
+// of which are there again or moved away, so one of its points came from the batch.
+// added holds the inserted points sorted by Morton key. The operation becomes
+// BATCH_FAILED; returns its index.
+static int makeRoom(OctreeNode *root, BatchOp *ops, BatchItem *added, int n, Point *p) {
+    OctreeNode *leaf = root;
+    while (!leaf->isLeaf) leaf = leaf->children[getOctant(&leaf->center, p)];
+    int latest = -1;
+    for (int j = 0; j < leaf->ptCount; j++) {
+        uint64_t key = mortonKey(root, &leaf->points[j]);
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (added[mid].key < key) lo = mid + 1; else hi = mid;
+        }
+        for (int i = lo; i < n && added[i].key == key; i++) {
+            Point *q = addedPoint(&ops[added[i].op]);
+            if (q != NULL && samePoint(q, &leaf->points[j]) && added[i].op > latest) latest = added[i].op;
+        }
+    }
+    if (latest == -1) {
+        fprintf(stderr, "applyBatch: no point of the batch in a full leaf\n");
+        exit(EXIT_FAILURE);
+    }
+    deletePoint_collision(root, addedPoint(&ops[latest]));
+    ops[latest].status = BATCH_FAILED;
+    return latest;
+}
+
+// Apply a batch of inserts, deletes and moves in two merged traversals.
+// All deletes, including the old position of every move, are applied first,
+// then all inserts and new positions, each pass sorted by Morton key so
+// operations that share a path descend it once. Subdivision and merging
+// happen at most once per node and pass, and with at least BATCH_PARALLEL_MIN
+// operations the top-level octants are processed on separate threads.
+// When a leaf at MAX_DEPTH overflows the points that fit are kept in Morton order.
+// A move that cannot be completed puts its point back where it was. Should other
+// operations of the batch have filled that MAX_DEPTH leaf meanwhile, the latest of
+// them is undone and fails instead, so no point is ever lost.
+// Returns the number of operations with status BATCH_DONE.
+int applyBatch(OctreeNode *root, BatchOp *ops, int count) {
+    for (int i = 0; i < count; i++) ops[i].status = BATCH_PENDING;
+
+    int n;
+    BatchItem *items = collectItems(root, ops, count, true, &n);
+    runPass(root, items, n, ops, deleteWork);
+    free(items);
+
+    items = collectItems(root, ops, count, false, &n);
+    // Equal points have equal keys, so only the run of items sharing a key is searched;
+    // the first of equal points (lowest operation index) is inserted
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        bool duplicate = false;
+        for (int j = kept - 1; j >= 0 && items[j].key == items[i].key; j--) {
+            if (samePoint(&items[j].point, &items[i].point)) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (duplicate) {
+            ops[items[i].op].status = BATCH_DUPLICATE;
+        } else {
+            items[kept++] = items[i];
+        }
+    }
+    runPass(root, items, kept, ops, insertWork);
+    free(items);
+
+    // Failed moves, including those undone below to make room, in the order they are put back
+    int *failed = (int *)malloc((count > 0 ? count : 1) * sizeof(int));
+    if (!failed) {
+        perror("Failed to allocate memory for batch");
+        exit(EXIT_FAILURE);
+    }
+    int pending = 0;
+    for (int i = 0; i < count; i++) {
+        BatchOp *op = &ops[i];
+        if (op->type == BATCH_MOVE && op->status != BATCH_DONE && op->status != BATCH_NOT_FOUND) {
+            op->status = BATCH_FAILED;
+            failed[pending++] = i;
+        }
+    }
+    BatchItem *added = pending > 0 ? collectItems(root, ops, count, false, &n) : NULL;
+    for (int f = 0; f < pending; f++) {
+        Point *old = &ops[failed[f]].point;
+        // Keep the point where it was, unless an insert of the batch already put it back
+        if (searchPoint(root, old) != NULL || insertPoint_collision(root, old)) continue;
+        int undone = makeRoom(root, ops, added, n, old);
+        if (ops[undone].type == BATCH_MOVE) failed[pending++] = undone;
+        insertPoint_collision(root, old);
+    }
+    free(added);
+    free(failed);
+
+    int done = 0;
+    for (int i = 0; i < count; i++) {
+        if (ops[i].status == BATCH_DONE) done++;
+    }
+    return done;
+}
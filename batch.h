@@ -0,0 +1,41 @@
+// batch.h
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "octree.h"
+
+// Define constants
+#define MORTON_BITS 21            // Bits per axis in a Morton key
+#define BATCH_PARALLEL_MIN 8192   // Operations from which top-level octants are applied on separate threads
+
+// Kind of mutation in a batch
+typedef enum BatchOpType {
+    BATCH_INSERT,   // Insert point
+    BATCH_DELETE,   // Delete point
+    BATCH_MOVE      // Move point to newPoint
+} BatchOpType;
+
+// Outcome of one operation, filled in by applyBatch()
+typedef enum BatchStatus {
+    BATCH_PENDING,
+    BATCH_DONE,
+    BATCH_DUPLICATE,   // Insert of a point already in the tree or earlier in the batch
+    BATCH_NOT_FOUND,   // Delete or move of a point not in the tree
+    BATCH_FAILED       // Max depth reached, or undone to make room for a failed move;
+                       // a failed move leaves the point where it was
+} BatchStatus;
+
+typedef struct BatchOp {
+    BatchOpType type;
+    Point point;
+    Point newPoint;
+    BatchStatus status;
+} BatchOp;
+
+// Function prototypes
+uint64_t mortonKey(OctreeNode *root, Point *p);
+int applyBatch(OctreeNode *root, BatchOp *ops, int count);
+
+#endif // BATCH_H
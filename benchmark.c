@@ -0,0 +1,534 @@
+// benchmark.c
+#include "octree.h"
+#include "spatial_hash.h"
+#include "frame_tree.h"
+#include "quant_tree.h"
+#include "batch.h"
+#include "compaction.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Define constants
+#define BENCH_POINTS 4000     // Default number of points per distribution
+#define BENCH_MOVES 200000    // Default number of move attempts per backend
+#define BENCH_CLUSTERS 8      // Number of clusters in the clustered distribution
+#define BENCH_SPREAD 150.0f   // Spread of a cluster around its center
+#define BENCH_FRAMES 20       // Frames stepped per moved fraction in the frame benchmark
+#define BENCH_QUERIES 2000    // Range queries in the compressed storage and compaction benchmarks
+#define BENCH_CHURN 4         // Replacements per point before the compaction benchmark
+
+// Results of running one backend over one distribution
+typedef struct BenchResult {
+    double buildMs;
+    double moveMs;
+    int moved;
+    int collisions;
+    int rejected;
+} BenchResult;
+
+// Small deterministic generator so both backends see the same move sequence
+static unsigned int benchRand(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 8) & 0xFFFFFF;
+}
+
+// Uniform float in [lo, hi)
+static float benchUniform(unsigned int *state, float lo, float hi) {
+    return lo + (hi - lo) * (benchRand(state) / (float)0x1000000);
+}
+
+// Wall-clock time in milliseconds, so multi-threaded rebuilds are measured fairly
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool inBounds(Point *p) {
+    return p->x >= -MAX_SIZE && p->x < MAX_SIZE &&
+           p->y >= -MAX_SIZE && p->y < MAX_SIZE &&
+           p->z >= -MAX_SIZE && p->z < MAX_SIZE;
+}
+
+// Fill pts with n points of the named distribution, returns the number generated
+static int generatePoints(const char *distribution, Point *pts, int n, unsigned int seed) {
+    unsigned int state = seed;
+    if (strcmp(distribution, "uniform") == 0) {
+        for (int i = 0; i < n; i++) {
+            pts[i].x = benchUniform(&state, -MAX_SIZE, MAX_SIZE);
+            pts[i].y = benchUniform(&state, -MAX_SIZE, MAX_SIZE);
+            pts[i].z = benchUniform(&state, -MAX_SIZE, MAX_SIZE);
+        }
+        return n;
+    }
+
+    // Clustered: points spread around a few random centers
+    Point centers[BENCH_CLUSTERS];
+    for (int c = 0; c < BENCH_CLUSTERS; c++) {
+        centers[c].x = benchUniform(&state, -MAX_SIZE + BENCH_SPREAD, MAX_SIZE - BENCH_SPREAD);
+        centers[c].y = benchUniform(&state, -MAX_SIZE + BENCH_SPREAD, MAX_SIZE - BENCH_SPREAD);
+        centers[c].z = benchUniform(&state, -MAX_SIZE + BENCH_SPREAD, MAX_SIZE - BENCH_SPREAD);
+    }
+    for (int i = 0; i < n; i++) {
+        Point *c = &centers[i % BENCH_CLUSTERS];
+        pts[i].x = c->x + benchUniform(&state, -BENCH_SPREAD, BENCH_SPREAD);
+        pts[i].y = c->y + benchUniform(&state, -BENCH_SPREAD, BENCH_SPREAD);
+        pts[i].z = c->z + benchUniform(&state, -BENCH_SPREAD, BENCH_SPREAD);
+    }
+    return n;
+}
+
+// Number of points other than self inside the collision box around target
+static int collisionCount(int count, Point *self, Point *target) {
+    if (self->x >= target->x - COLLISION_SIZE && self->x <= target->x + COLLISION_SIZE &&
+        self->y >= target->y - COLLISION_SIZE && self->y <= target->y + COLLISION_SIZE &&
+        self->z >= target->z - COLLISION_SIZE && self->z <= target->z + COLLISION_SIZE) {
+        count--;
+    }
+    return count;
+}
+
+// Move random points with collision checks through the octree. Moves the octree
+// refuses at MAX_DEPTH are marked in refused.
+static BenchResult runOctree(Point *pts, int n, int moves, unsigned int seed, bool *refused) {
+    BenchResult r = {0};
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+
+    double start = nowMs();
+    for (int i = 0; i < n; i++) insertPoint_collision(root, &pts[i]);
+    r.buildMs = nowMs() - start;
+
+    unsigned int state = seed;
+    start = nowMs();
+    for (int m = 0; m < moves; m++) {
+        int i = benchRand(&state) % n;
+        Point oldPoint = pts[i];
+        Point newPoint = {
+            oldPoint.x + benchUniform(&state, -STEP, STEP),
+            oldPoint.y + benchUniform(&state, -STEP, STEP),
+            oldPoint.z + benchUniform(&state, -STEP, STEP)
+        };
+        refused[m] = false;
+        if (!inBounds(&newPoint)) continue;
+
+        Point min = { newPoint.x - COLLISION_SIZE, newPoint.y - COLLISION_SIZE, newPoint.z - COLLISION_SIZE };
+        Point max = { newPoint.x + COLLISION_SIZE, newPoint.y + COLLISION_SIZE, newPoint.z + COLLISION_SIZE };
+        if (collisionCount(countPointsInCube(root, &min, &max), &oldPoint, &newPoint) > 0) {
+            r.collisions++;
+            continue;
+        }
+        deletePoint_collision(root, &oldPoint);
+        if (insertPoint_collision(root, &newPoint)) {
+            pts[i] = newPoint;
+            r.moved++;
+        } else {
+            insertPoint_collision(root, &oldPoint);
+            refused[m] = true;
+            r.rejected++;
+        }
+    }
+    r.moveMs = nowMs() - start;
+    freeTree(root);
+    return r;
+}
+
+// Move random points with collision checks through the spatial-hash grid. With
+// refused given, the moves the octree refused are skipped too, so that both
+// backends go through the same positions.
+static BenchResult runGrid(Point *pts, int n, int moves, unsigned int seed, const bool *refused) {
+    BenchResult r = {0};
+    SpatialHash *grid = createGrid(GRID_CELL_SIZE);
+
+    double start = nowMs();
+    for (int i = 0; i < n; i++) gridInsertPoint(grid, &pts[i]);
+    r.buildMs = nowMs() - start;
+
+    unsigned int state = seed;
+    start = nowMs();
+    for (int m = 0; m < moves; m++) {
+        int i = benchRand(&state) % n;
+        Point oldPoint = pts[i];
+        Point newPoint = {
+            oldPoint.x + benchUniform(&state, -STEP, STEP),
+            oldPoint.y + benchUniform(&state, -STEP, STEP),
+            oldPoint.z + benchUniform(&state, -STEP, STEP)
+        };
+        if (!inBounds(&newPoint)) continue;
+
+        Point min = { newPoint.x - COLLISION_SIZE, newPoint.y - COLLISION_SIZE, newPoint.z - COLLISION_SIZE };
+        Point max = { newPoint.x + COLLISION_SIZE, newPoint.y + COLLISION_SIZE, newPoint.z + COLLISION_SIZE };
+        if (collisionCount(gridCountPointsInCube(grid, &min, &max), &oldPoint, &newPoint) > 0) {
+            r.collisions++;
+            continue;
+        }
+        if (refused && refused[m]) {
+            r.rejected++;
+            continue;
+        }
+        gridUpdatePoint(grid, &oldPoint, &newPoint);
+        pts[i] = newPoint;
+        r.moved++;
+    }
+    r.moveMs = nowMs() - start;
+    freeGrid(grid);
+    return r;
+}
+
+// Keep only the points the octree accepts so both backends hold the same set
+static int filterAccepted(Point *pts, int n) {
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (searchPoint(root, &pts[i]) == NULL && insertPoint_collision(root, &pts[i])) {
+            pts[kept++] = pts[i];
+        }
+    }
+    freeTree(root);
+    return kept;
+}
+
+// Number of points stored below node, including those moved outside the root cube
+static int countTreePoints(OctreeNode *node) {
+    if (node->isLeaf) return node->ptCount;
+    int count = 0;
+    for (int i = 0; i < 8; i++) count += countTreePoints(node->children[i]);
+    return count;
+}
+
+// True if the tree holds exactly the n given points
+static bool holdsExactly(OctreeNode *root, Point *pts, int n) {
+    if (countTreePoints(root) != n) return false;
+    for (int i = 0; i < n; i++) {
+        if (searchPoint(root, &pts[i]) == NULL) return false;
+    }
+    return true;
+}
+
+// Step frames in which the given fraction of points moves, with a fixed rebuild policy
+// or, for a negative rebuildFraction, the adaptive one. The final positions are copied
+// to final, and held tells whether the tree holds exactly those points.
+static double runFrames(Point *pts, int n, float movedFraction, float rebuildFraction, unsigned int seed,
+                        Point *final, bool *held) {
+    FrameTree *ft = createFrameTree(pts, n);
+    if (rebuildFraction >= 0.0f) {
+        ft->rebuildFraction = rebuildFraction;
+        ft->adaptive = false;
+    }
+    Point *next = (Point *)malloc(n * sizeof(Point));
+    if (!next) {
+        perror("Failed to allocate memory for points");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int state = seed;
+    double total = 0.0;
+    for (int f = 0; f < BENCH_FRAMES; f++) {
+        memcpy(next, ft->positions, n * sizeof(Point));
+        for (int i = 0; i < n; i++) {
+            if (benchUniform(&state, 0.0f, 1.0f) >= movedFraction) continue;
+            Point p = {
+                next[i].x + benchUniform(&state, -STEP, STEP),
+                next[i].y + benchUniform(&state, -STEP, STEP),
+                next[i].z + benchUniform(&state, -STEP, STEP)
+            };
+            if (inBounds(&p)) next[i] = p;
+        }
+        double start = nowMs();
+        stepFrame(ft, next);
+        total += nowMs() - start;
+    }
+    memcpy(final, ft->positions, n * sizeof(Point));
+    *held = holdsExactly(ft->root, ft->positions, n);
+    free(next);
+    freeFrameTree(ft);
+    return total / BENCH_FRAMES;
+}
+
+// Number of nodes of a pointer-based tree
+static int countNodes(OctreeNode *node) {
+    if (node == NULL) return 0;
+    int count = 1;
+    if (!node->isLeaf) {
+        for (int i = 0; i < 8; i++) count += countNodes(node->children[i]);
+    }
+    return count;
+}
+
+// Compare memory and range query time of the pointer tree and the compressed tree
+static void runCompressed(Point *pts, int n, unsigned int seed) {
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+    for (int i = 0; i < n; i++) insertPoint_collision(root, &pts[i]);
+    QuantOctree *qt = buildQuantTree(pts, n);
+
+    double treeBytes = (double)countNodes(root) * sizeof(OctreeNode);
+    double quantBytes = (double)quantMemoryBytes(qt);
+    printf("compressed: %d uniform points, %d-bit coordinates, tolerance %.5f at depth %d\n",
+           qt->ptCount, QUANT_BITS, quantTolerance(qt, MAX_DEPTH), MAX_DEPTH);
+    printf("  octree   %8.1f bytes/point\n", treeBytes / qt->ptCount);
+    printf("  quant    %8.1f bytes/point   (%.1fx smaller)\n", quantBytes / qt->ptCount, treeBytes / quantBytes);
+
+    unsigned int state = seed;
+    int treeCount = 0, quantCount = 0;
+    double treeMs = 0.0, quantMs = 0.0;
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        Point min = { benchUniform(&state, -MAX_SIZE, MAX_SIZE), benchUniform(&state, -MAX_SIZE, MAX_SIZE), benchUniform(&state, -MAX_SIZE, MAX_SIZE) };
+        float edge = benchUniform(&state, 0.0f, 200.0f);
+        Point max = { min.x + edge, min.y + edge, min.z + edge };
+        double start = nowMs();
+        treeCount += countPointsInCube(root, &min, &max);
+        treeMs += nowMs() - start;
+        start = nowMs();
+        quantRangeQuery(qt, &min, &max, &quantCount, NULL);
+        quantMs += nowMs() - start;
+    }
+    printf("  %d range queries: octree %.2f ms (%d points), quant %.2f ms (%d points, %.2fx the octree time)\n\n",
+           BENCH_QUERIES, treeMs, treeCount, quantMs, quantCount, treeMs > 0.0 ? quantMs / treeMs : 0.0);
+
+    freeQuantTree(qt);
+    freeTree(root);
+}
+
+// Time BENCH_QUERIES random range queries, adding the points found to *found
+static double timeRangeQueries(OctreeNode *root, unsigned int seed, int *found) {
+    unsigned int state = seed;
+    double start = nowMs();
+    for (int q = 0; q < BENCH_QUERIES; q++) {
+        Point min = { benchUniform(&state, -MAX_SIZE, MAX_SIZE), benchUniform(&state, -MAX_SIZE, MAX_SIZE), benchUniform(&state, -MAX_SIZE, MAX_SIZE) };
+        float edge = benchUniform(&state, 0.0f, 200.0f);
+        Point max = { min.x + edge, min.y + edge, min.z + edge };
+        *found += countPointsInCube(root, &min, &max);
+    }
+    return nowMs() - start;
+}
+
+// Replace points BENCH_CHURN times their number by clustered ones, then compact the tree in
+// slices of COMPACT_SLICE_NODES and compare its metrics and range query time
+static void runCompaction(Point *pts, int n, unsigned int seed) {
+    int churn = n * BENCH_CHURN;
+    Point *live = (Point *)malloc(n * sizeof(Point));
+    Point *incoming = (Point *)malloc(churn * sizeof(Point));
+    if (!live || !incoming) {
+        perror("Failed to allocate memory for points");
+        exit(EXIT_FAILURE);
+    }
+    churn = generatePoints("clustered", incoming, churn, seed);
+
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        if (insertPoint_collision(root, &pts[i])) live[count++] = pts[i];
+    }
+    unsigned int state = seed;
+    for (int i = 0; i < churn && count > 0; i++) {
+        // Rejected points still leave their subdivisions behind
+        if (searchPoint(root, &incoming[i]) != NULL || !insertPoint_collision(root, &incoming[i])) continue;
+        int victim = benchRand(&state) % count;
+        deletePoint_collision(root, &live[victim]);
+        live[victim] = incoming[i];
+    }
+
+    TreeMetrics before, after;
+    measureTree(root, &before);
+    int foundBefore = 0, foundAfter = 0;
+    double queryBefore = timeRangeQueries(root, seed, &foundBefore);
+
+    Compactor *c = createCompactor(root);
+    int slices = 0;
+    double total = 0.0, longest = 0.0;
+    bool done = false;
+    while (!done) {
+        double start = nowMs();
+        done = compactStep(c, COMPACT_SLICE_NODES);
+        double slice = nowMs() - start;
+        total += slice;
+        if (slice > longest) longest = slice;
+        slices++;
+    }
+    measureTree(root, &after);
+    double queryAfter = timeRangeQueries(root, seed, &foundAfter);
+
+    printf("compaction: %d points after %d clustered replacements\n", count, churn);
+    printf("  before  nodes %7d   empty %5.1f%%   removable %5.1f%%   %7.1f bytes/point   %d range queries %7.2f ms (%d points)%s\n",
+           before.nodes, before.emptyRatio * 100.0f, 100.0f * before.removableNodes / before.nodes,
+           before.bytesPerPoint, BENCH_QUERIES, queryBefore, foundBefore, compactionDue(&before) ? "   compaction due" : "");
+    printf("  after   nodes %7d   empty %5.1f%%   removable %5.1f%%   %7.1f bytes/point   %d range queries %7.2f ms (%d points)\n",
+           after.nodes, after.emptyRatio * 100.0f, 100.0f * after.removableNodes / after.nodes,
+           after.bytesPerPoint, BENCH_QUERIES, queryAfter, foundAfter);
+    printf("  %d slices of %d nodes, %.2f ms in total, longest %.3f ms (%d collapsed, %d moved)\n\n",
+           slices, COMPACT_SLICE_NODES, total, longest, c->collapsed, c->moved);
+
+    freeCompactor(c);
+    freeTree(root);
+    free(live);
+    free(incoming);
+}
+
+// Compare inserting and then moving every point one by one against two batches,
+// and check that both trees hold the points their outcomes say they should.
+// Returns false on a mismatch.
+static bool runBatch(Point *pts, int n, unsigned int seed) {
+    Point center = {0.0f, 0.0f, 0.0f};
+    BatchOp *ops = (BatchOp *)malloc(n * sizeof(BatchOp));
+    Point *expected = (Point *)malloc(n * sizeof(Point));
+    bool *movedSingle = (bool *)malloc(n * sizeof(bool));
+    if (!ops || !expected || !movedSingle) {
+        perror("Failed to allocate memory for batch");
+        exit(EXIT_FAILURE);
+    }
+    unsigned int state = seed;
+    for (int i = 0; i < n; i++) {
+        ops[i].point = pts[i];
+        ops[i].newPoint.x = pts[i].x + benchUniform(&state, -STEP, STEP);
+        ops[i].newPoint.y = pts[i].y + benchUniform(&state, -STEP, STEP);
+        ops[i].newPoint.z = pts[i].z + benchUniform(&state, -STEP, STEP);
+    }
+
+    OctreeNode *single = createNode(center, MAX_SIZE, 0);
+    double start = nowMs();
+    for (int i = 0; i < n; i++) {
+        if (searchPoint(single, &ops[i].point) == NULL) insertPoint_collision(single, &ops[i].point);
+    }
+    double singleInsert = nowMs() - start;
+
+    OctreeNode *batched = createNode(center, MAX_SIZE, 0);
+    for (int i = 0; i < n; i++) ops[i].type = BATCH_INSERT;
+    start = nowMs();
+    int inserted = applyBatch(batched, ops, n);
+    double batchInsert = nowMs() - start;
+
+    // The points were all accepted one by one, so both trees must hold all of them
+    bool same = inserted == n && holdsExactly(single, pts, n) && holdsExactly(batched, pts, n);
+
+    start = nowMs();
+    for (int i = 0; i < n; i++) {
+        movedSingle[i] = false;
+        if (searchPoint(single, &ops[i].point) == NULL) continue;
+        deletePoint_collision(single, &ops[i].point);
+        if (searchPoint(single, &ops[i].newPoint) == NULL && insertPoint_collision(single, &ops[i].newPoint)) {
+            movedSingle[i] = true;
+        } else {
+            insertPoint_collision(single, &ops[i].point);
+        }
+    }
+    double singleMove = nowMs() - start;
+
+    for (int i = 0; i < n; i++) ops[i].type = BATCH_MOVE;
+    start = nowMs();
+    int moved = applyBatch(batched, ops, n);
+    double batchMove = nowMs() - start;
+
+    // Every point is either at its new position or, if its move failed, where it was.
+    // The trees differ only where a full MAX_DEPTH leaf was filled in a different order.
+    int differ = 0;
+    for (int i = 0; i < n; i++) {
+        expected[i] = movedSingle[i] ? ops[i].newPoint : ops[i].point;
+        if (movedSingle[i] != (ops[i].status == BATCH_DONE)) differ++;
+    }
+    same = same && holdsExactly(single, expected, n);
+    for (int i = 0; i < n; i++) expected[i] = ops[i].status == BATCH_DONE ? ops[i].newPoint : ops[i].point;
+    same = same && holdsExactly(batched, expected, n);
+
+    printf("batch: %d uniform points\n", n);
+    printf("  one by one   insert %8.2f ms   move %8.2f ms\n", singleInsert, singleMove);
+    printf("  batched      insert %8.2f ms   move %8.2f ms   (%d inserted, %d moved)\n",
+           batchInsert, batchMove, inserted, moved);
+    if (same) {
+        printf("  both trees hold exactly the expected points; %d moves decided differently at full MAX_DEPTH leaves\n\n", differ);
+    } else {
+        printf("  MISMATCH between batched and one by one point sets\n\n");
+    }
+
+    freeTree(single);
+    freeTree(batched);
+    free(ops);
+    free(expected);
+    free(movedSingle);
+    return same;
+}
+
+static void printResult(const char *backend, BenchResult *r) {
+    printf("  %-8s build %9.2f ms   moves %9.2f ms   moved %7d   collisions %7d   rejected %6d\n",
+           backend, r->buildMs, r->moveMs, r->moved, r->collisions, r->rejected);
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : BENCH_POINTS;
+    int moves = argc > 2 ? atoi(argv[2]) : BENCH_MOVES;
+    if (n <= 0 || moves < 0) {
+        fprintf(stderr, "Usage: %s [points] [moves]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *distributions[] = {"uniform", "clustered"};
+    int mismatches = 0;
+    Point *generated = (Point *)malloc(n * sizeof(Point));
+    Point *octreePts = (Point *)malloc(n * sizeof(Point));
+    Point *gridPts = (Point *)malloc(n * sizeof(Point));
+    bool *refused = (bool *)malloc((moves > 0 ? moves : 1) * sizeof(bool));
+    if (!generated || !octreePts || !gridPts || !refused) {
+        perror("Failed to allocate memory for points");
+        return EXIT_FAILURE;
+    }
+
+    for (int d = 0; d < 2; d++) {
+        int count = generatePoints(distributions[d], generated, n, 12345u + d);
+        count = filterAccepted(generated, count);
+        printf("%s: %d of %d points accepted by the octree (MAX_DEPTH %d), %d moves\n",
+               distributions[d], count, n, MAX_DEPTH, moves);
+        if (count == 0) continue;
+
+        memcpy(octreePts, generated, count * sizeof(Point));
+        memcpy(gridPts, generated, count * sizeof(Point));
+        BenchResult octree = runOctree(octreePts, count, moves, 777u + d, refused);
+        BenchResult grid = runGrid(gridPts, count, moves, 777u + d, refused);
+        printResult("octree", &octree);
+        printResult("grid", &grid);
+
+        // The grid skips the moves the octree refused, so both must take exactly the
+        // same decisions and end with the same positions
+        if (octree.moved != grid.moved || octree.collisions != grid.collisions || octree.rejected != grid.rejected ||
+            memcmp(octreePts, gridPts, count * sizeof(Point)) != 0) {
+            printf("  MISMATCH between octree and grid collision results\n");
+            mismatches++;
+        }
+        printf("  faster backend for moves: %s\n\n", grid.moveMs < octree.moveMs ? "grid" : "octree");
+    }
+
+    int count = filterAccepted(generated, generatePoints("uniform", generated, n, 12345u));
+    if (count > 0) runCompressed(generated, count, 4242u);
+    if (count > 0 && !runBatch(generated, count, 5151u)) mismatches++;
+    if (count > 0) runCompaction(generated, count, 6161u);
+
+    // Per-frame cost of incremental updates against a full parallel rebuild
+    printf("frames: %d uniform points, %d frames per row, switch at %.0f%% moved until both costs are measured\n",
+           count, BENCH_FRAMES, REBUILD_FRACTION * 100.0f);
+    float fractions[] = {0.01f, 0.05f, 0.25f, 0.5f, 0.75f, 0.9f, 1.0f};
+    for (int f = 0; f < 7 && count > 0; f++) {
+        bool heldIncremental, heldRebuild, heldAdaptive;
+        double incremental = runFrames(generated, count, fractions[f], 2.0f, 99u, octreePts, &heldIncremental);
+        double rebuild = runFrames(generated, count, fractions[f], 0.0f, 99u, gridPts, &heldRebuild);
+        printf("  %5.1f%% moved   incremental %8.3f ms/frame   rebuild %8.3f ms/frame   ",
+               fractions[f] * 100.0f, incremental, rebuild);
+        bool same = heldIncremental && heldRebuild && memcmp(octreePts, gridPts, count * sizeof(Point)) == 0;
+        double adaptive = runFrames(generated, count, fractions[f], -1.0f, 99u, gridPts, &heldAdaptive);
+        same = same && heldAdaptive && memcmp(octreePts, gridPts, count * sizeof(Point)) == 0;
+        printf("adaptive %8.3f ms/frame   faster: %s\n", adaptive, incremental < rebuild ? "incremental" : "rebuild");
+
+        // All three keep the same points, whichever path each frame took
+        if (!same) {
+            printf("  MISMATCH between rebuilt and incremental frame trees\n");
+            mismatches++;
+        }
+    }
+
+    free(generated);
+    free(octreePts);
+    free(gridPts);
+    free(refused);
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,204 @@
+// compaction.c
+#include "compaction.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Add node and its subtree to the metrics. Returns the number of points below node,
+// with the number of nodes and of nodes compaction would free in *nodes and *removable.
+static int measureNode(OctreeNode *node, bool isRoot, TreeMetrics *m, int *nodes, int *removable) {
+    m->nodes++;
+    m->nodesAtDepth[node->depth]++;
+    if (!isRoot && !isBlockNode(node)) m->scatteredNodes++;
+
+    int points = 0;
+    *nodes = 1;
+    *removable = 0;
+    if (node->isLeaf) {
+        points = node->ptCount;
+        m->leaves++;
+        m->leavesWithPoints[points]++;
+        m->pointsAtDepth[node->depth] += points;
+    } else {
+        int childRemovable = 0;
+        for (int i = 0; i < 8; i++) {
+            int n, r;
+            points += measureNode(node->children[i], false, m, &n, &r);
+            *nodes += n;
+            childRemovable += r;
+        }
+        // A subtree that fits into one leaf is replaced by that leaf
+        *removable = points <= MAX_POINTS ? *nodes - 1 : childRemovable;
+    }
+    if (points == 0) m->emptyNodes++;
+    return points;
+}
+
+// Measure the shape and memory use of a tree
+void measureTree(OctreeNode *root, TreeMetrics *m) {
+    *m = (TreeMetrics){0};
+    int nodes;
+    m->points = measureNode(root, true, m, &nodes, &m->removableNodes);
+    m->leafOccupancy = (float)m->points / (m->leaves * MAX_POINTS);
+    m->emptyRatio = (float)m->emptyNodes / m->nodes;
+    m->bytesPerPoint = m->points > 0 ? (float)(m->nodes * sizeof(OctreeNode)) / m->points : 0.0f;
+}
+
+// Print the metrics as a small report
+void printTreeMetrics(TreeMetrics *m, FILE *fp) {
+    fprintf(fp, "nodes %d (leaves %d), points %d, %.1f bytes/point\n",
+            m->nodes, m->leaves, m->points, m->bytesPerPoint);
+    fprintf(fp, "depth    nodes   points\n");
+    for (int d = 0; d <= MAX_DEPTH; d++) {
+        fprintf(fp, "%5d %8d %8d\n", d, m->nodesAtDepth[d], m->pointsAtDepth[d]);
+    }
+    fprintf(fp, "leaf occupancy %.1f%%:", m->leafOccupancy * 100.0f);
+    for (int p = 0; p <= MAX_POINTS; p++) {
+        fprintf(fp, "  %d with %d point%s", m->leavesWithPoints[p], p, p == 1 ? "" : "s");
+    }
+    fprintf(fp, "\nempty nodes %.1f%%, removable by compaction %.1f%%, outside compacted layout %.1f%%\n",
+            m->emptyRatio * 100.0f,
+            100.0f * m->removableNodes / m->nodes,
+            m->nodes > 1 ? 100.0f * m->scatteredNodes / (m->nodes - 1) : 0.0f);
+}
+
+// Check if compaction would free or regroup enough of the tree to be worth running
+bool compactionDue(TreeMetrics *m) {
+    if (m->nodes <= 1) return false;
+    return m->removableNodes >= COMPACT_REMOVABLE_RATIO * m->nodes ||
+           m->scatteredNodes >= COMPACT_SCATTERED_RATIO * (m->nodes - 1);
+}
+
+// Move the position past the subtree it points at; marks the walk finished after the root
+static void skipSubtree(Compactor *c) {
+    while (c->length > 0) {
+        if (++c->path[c->length - 1] < 8) return;
+        c->length--;
+    }
+    c->length = -1;
+}
+
+// Node at the current position, or NULL once the walk is finished. A path running
+// into a leaf means that subtree was merged away since; the walk goes on after it.
+static OctreeNode *currentNode(Compactor *c) {
+    OctreeNode *node = c->root;
+    int k = 0;
+    while (k < c->length) {
+        if (node->isLeaf) {
+            c->length = k;
+            skipSubtree(c);
+            node = c->root;
+            k = 0;
+        } else {
+            node = node->children[c->path[k++]];
+        }
+    }
+    return c->length < 0 ? NULL : node;
+}
+
+// Gather the points below node; false once more than MAX_POINTS are found
+static bool gatherPoints(OctreeNode *node, Point *points, int *count, int *visited) {
+    (*visited)++;
+    if (node->isLeaf) {
+        for (int j = 0; j < node->ptCount; j++) {
+            if (*count == MAX_POINTS) return false;
+            points[(*count)++] = node->points[j];
+        }
+        return true;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (!gatherPoints(node->children[i], points, count, visited)) return false;
+    }
+    return true;
+}
+
+// Turn an internal node into a leaf if all the points below it fit into one.
+// The points stay the same, so the node keeps its version stamp.
+static bool collapseNode(OctreeNode *node, int *visited) {
+    Point points[MAX_POINTS];
+    int count = 0;
+    if (!gatherPoints(node, points, &count, visited)) return false;
+
+    for (int i = 0; i < 8; i++) {
+        freeTree(node->children[i]);
+        node->children[i] = NULL;
+    }
+    for (int j = 0; j < count; j++) node->points[j] = points[j];
+    node->ptCount = count;
+    node->isLeaf = 1;
+    return true;
+}
+
+// Create a compactor for the tree below root
+Compactor *createCompactor(OctreeNode *root) {
+    Compactor *c = (Compactor *)calloc(1, sizeof(Compactor));
+    if (!c) {
+        perror("Failed to allocate memory for compactor");
+        exit(EXIT_FAILURE);
+    }
+    c->root = root;
+    c->phase = COMPACT_COUNTING;
+    return c;
+}
+
+// Advance the compaction by about budget visited nodes. Must not run while the
+// tree is used on another thread. Returns true once the compaction is finished.
+bool compactStep(Compactor *c, int budget) {
+    int visited = 0;
+    while (visited < budget) {
+        OctreeNode *node = currentNode(c);
+        if (node == NULL) {
+            if (c->phase == COMPACT_COUNTING) {
+                // The root stays where the caller keeps it
+                c->phase = COMPACT_MOVING;
+                c->block = createNodeBlock(c->nodes);
+                c->length = 0;
+                continue;
+            }
+            if (c->phase == COMPACT_MOVING) {
+                closeNodeBlock(c->block);
+                c->block = NULL;
+                c->phase = COMPACT_DONE;
+            }
+            return true;
+        }
+
+        visited++;
+        if (c->phase == COMPACT_COUNTING) {
+            if (!node->isLeaf && collapseNode(node, &visited)) c->collapsed++;
+            if (!node->isLeaf) c->nodes += 8;
+        } else if (!node->isLeaf) {
+            // Siblings are placed together, before any of their children
+            for (int i = 0; i < 8; i++) {
+                OctreeNode *copy = placeNode(c->block, node->children[i]);
+                if (copy != node->children[i]) {
+                    node->children[i] = copy;
+                    c->moved++;
+                }
+            }
+            visited += 8;
+        }
+
+        // Continue with the first child, or after this subtree
+        if (node->isLeaf) {
+            skipSubtree(c);
+        } else {
+            c->path[c->length++] = 0;
+        }
+    }
+    return false;
+}
+
+// Free a compactor; nodes it already moved stay valid
+void freeCompactor(Compactor *c) {
+    if (c) {
+        if (c->block) closeNodeBlock(c->block);
+        free(c);
+    }
+}
+
+// Compact a tree in one go
+void compactTree(OctreeNode *root) {
+    Compactor *c = createCompactor(root);
+    while (!compactStep(c, COMPACT_SLICE_NODES));
+    freeCompactor(c);
+}
@@ -0,0 +1,60 @@
+// compaction.h
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "octree.h"
+
+// Define constants
+#define COMPACT_SLICE_NODES 4096         // Nodes visited by one compaction step
+#define COMPACT_REMOVABLE_RATIO 0.25f    // Share of removable nodes from which compaction is advised
+#define COMPACT_SCATTERED_RATIO 0.5f     // Share of nodes outside the compacted layout from which it is advised
+
+// Shape and memory use of a tree, to decide when to compact it
+typedef struct TreeMetrics {
+    int nodes;
+    int leaves;
+    int points;
+    int nodesAtDepth[MAX_DEPTH + 1];     // Depth histogram
+    int pointsAtDepth[MAX_DEPTH + 1];
+    int leavesWithPoints[MAX_POINTS + 1]; // Leaf occupancy histogram
+    int emptyNodes;                      // Nodes without any point below them
+    int removableNodes;                  // Nodes compaction would free
+    int scatteredNodes;                  // Nodes (except the root) not in the compacted layout
+    float leafOccupancy;                 // Average points per leaf divided by MAX_POINTS
+    float emptyRatio;
+    float bytesPerPoint;
+} TreeMetrics;
+
+typedef enum { COMPACT_COUNTING, COMPACT_MOVING, COMPACT_DONE } CompactPhase;
+
+// Compaction of one tree, advanced in bounded steps between other work.
+// The counting phase turns every internal node whose subtree fits into a
+// single leaf into that leaf and counts the remaining nodes. The moving phase
+// copies all nodes except the root into one block, the eight children of a
+// node next to each other and subtrees in depth-first Morton order.
+// The position of the walk is kept as a path of octants from the root, so the
+// tree may be changed between steps: subtrees that disappeared are skipped and
+// nodes created behind the position stay where they are.
+typedef struct Compactor {
+    OctreeNode *root;
+    CompactPhase phase;
+    int path[MAX_DEPTH];                 // Octants leading from the root to the next node to visit
+    int length;
+    int nodes;                           // Nodes counted for the block
+    NodeBlock *block;
+    int collapsed;                       // Internal nodes turned into leaves
+    int moved;                           // Nodes copied into the block
+} Compactor;
+
+// Function prototypes
+void measureTree(OctreeNode *root, TreeMetrics *m);
+void printTreeMetrics(TreeMetrics *m, FILE *fp);
+bool compactionDue(TreeMetrics *m);
+Compactor *createCompactor(OctreeNode *root);
+bool compactStep(Compactor *c, int budget);
+void freeCompactor(Compactor *c);
+void compactTree(OctreeNode *root);
+
+#endif // COMPACTION_H
@@ -0,0 +1,281 @@
+// frame_tree.c
+#include "frame_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Work for one thread: the points of one top-level octant and the subtree to fill
+typedef struct OctantBuild {
+    OctreeNode *node;
+    Point *positions;
+    int *indices;      // Indices into positions of the octant's points, in insertion order
+    int count;
+    bool *refused;     // Set for each point refused at MAX_DEPTH, may be NULL
+} OctantBuild;
+
+static void *buildOctant(void *arg) {
+    OctantBuild *build = (OctantBuild *)arg;
+    for (int i = 0; i < build->count; i++) {
+        int index = build->indices[i];
+        bool inserted = insertPoint_collision(build->node, &build->positions[index]);
+        if (build->refused) build->refused[index] = !inserted;
+    }
+    return NULL;
+}
+
+static double frameClockMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Fold the cost of the latest frame into a measured cost
+static double updateCost(double cost, double latest) {
+    return cost == 0.0 ? latest : cost + FRAME_COST_WEIGHT * (latest - cost);
+}
+
+// Rebuilding pays off once moving the points one by one would cost more than
+// building the whole tree, i.e. from rebuildMs / moveMs of the points moved
+static void adaptRebuildFraction(FrameTree *ft) {
+    if (!ft->adaptive || ft->moveMs <= 0.0 || ft->rebuildMs <= 0.0) return;
+    ft->rebuildFraction = (float)(ft->rebuildMs / ft->moveMs);   // Above 1 a rebuild never pays off
+}
+
+// Build a tree from scratch, one thread per top-level octant, marking in
+// refused (when not NULL) the points that did not fit at MAX_DEPTH.
+// Points keep their order within an octant, so the result is the same tree
+// that inserting them one by one into an empty root would give.
+static OctreeNode *buildTree(Point *positions, int count, bool *refused) {
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+    if (count <= MAX_POINTS) {
+        for (int i = 0; i < count; i++) {
+            bool inserted = insertPoint_collision(root, &positions[i]);
+            if (refused) refused[i] = !inserted;
+        }
+        return root;
+    }
+    subdivideNode(root);
+
+    // Partition the points by top-level octant, keeping their order
+    int sizes[8] = {0};
+    int offsets[8];
+    for (int i = 0; i < count; i++) sizes[getOctant(&root->center, &positions[i])]++;
+    offsets[0] = 0;
+    for (int o = 1; o < 8; o++) offsets[o] = offsets[o - 1] + sizes[o - 1];
+
+    int *sorted = (int *)malloc(count * sizeof(int));
+    if (!sorted) {
+        perror("Failed to allocate memory for rebuild");
+        exit(EXIT_FAILURE);
+    }
+    int fill[8];
+    memcpy(fill, offsets, sizeof(fill));
+    for (int i = 0; i < count; i++) {
+        sorted[fill[getOctant(&root->center, &positions[i])]++] = i;
+    }
+
+    OctantBuild builds[8];
+    pthread_t threads[8];
+    bool started[8] = {false};
+    for (int o = 0; o < 8; o++) {
+        builds[o].node = root->children[o];
+        builds[o].positions = positions;
+        builds[o].indices = sorted + offsets[o];
+        builds[o].count = sizes[o];
+        builds[o].refused = refused;
+        if (sizes[o] > 0 && pthread_create(&threads[o], NULL, buildOctant, &builds[o]) == 0) {
+            started[o] = true;
+        } else {
+            buildOctant(&builds[o]);  // Empty octant, or no thread available
+        }
+    }
+    for (int o = 0; o < 8; o++) {
+        if (started[o]) pthread_join(threads[o], NULL);
+    }
+
+    free(sorted);
+    return root;
+}
+
+OctreeNode *buildTreeParallel(Point *positions, int count) {
+    return buildTree(positions, count, NULL);
+}
+
+// Put back the old position of every refused moved point, in the order of refused.
+// Should other moved points have filled that MAX_DEPTH leaf, the latest of them is
+// refused as well and put back in turn: before the frame the leaf's cell held at most
+// MAX_POINTS points, so one of those it holds now came from a move. moved lists the
+// indices of the moved points in increasing order and accepted marks those at their
+// new position; refused must have room for every moved point.
+static void keepRefused(OctreeNode *root, Point *positions, Point *newPositions,
+                        int *moved, int movedCount, bool *accepted, int *refused, int refusedCount) {
+    for (int r = 0; r < refusedCount; r++) {
+        Point *old = &positions[refused[r]];
+        if (insertPoint_collision(root, old)) continue;
+
+        OctreeNode *leaf = root;
+        while (!leaf->isLeaf) leaf = leaf->children[getOctant(&leaf->center, old)];
+        int latest = -1;
+        for (int m = movedCount - 1; m >= 0 && latest == -1; m--) {
+            Point *q = &newPositions[moved[m]];
+            if (!accepted[moved[m]]) continue;
+            for (int j = 0; j < leaf->ptCount; j++) {
+                Point *p = &leaf->points[j];
+                if (p->x == q->x && p->y == q->y && p->z == q->z) latest = moved[m];
+            }
+        }
+        if (latest == -1) continue;   // Only when the initial positions did not fit either
+        deletePoint_collision(root, &newPositions[latest]);
+        accepted[latest] = false;
+        refused[refusedCount++] = latest;
+        insertPoint_collision(root, old);
+    }
+}
+
+// Create a frame tree over the initial positions
+FrameTree *createFrameTree(Point *positions, int count) {
+    FrameTree *ft = (FrameTree *)malloc(sizeof(FrameTree));
+    Point *copy = (Point *)malloc((count > 0 ? count : 1) * sizeof(Point));
+    if (!ft || !copy) {
+        perror("Failed to allocate memory for frame tree");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, positions, count * sizeof(Point));
+    ft->positions = copy;
+    ft->count = count;
+    ft->rebuildFraction = REBUILD_FRACTION;
+    ft->adaptive = true;
+    ft->moveMs = 0.0;
+    ft->samePath = 0;
+    ft->lastRebuilt = false;
+    ft->frames = 0;
+    ft->rebuilds = 0;
+    double start = frameClockMs();
+    ft->root = buildTreeParallel(copy, count);
+    ft->rebuildMs = count > 0 ? (frameClockMs() - start) / count : 0.0;
+    pthread_rwlock_init(&ft->lock, NULL);
+    return ft;
+}
+
+// Get the tree to query; it stays valid until endFrameQuery()
+OctreeNode *beginFrameQuery(FrameTree *ft) {
+    pthread_rwlock_rdlock(&ft->lock);
+    return ft->root;
+}
+
+void endFrameQuery(FrameTree *ft) {
+    pthread_rwlock_unlock(&ft->lock);
+}
+
+// Advance to the next frame. Rebuilds when at least rebuildFraction of the
+// points moved, otherwise moves them in the current tree. Either way the tree
+// first holds the points that did not move, then takes the new positions in
+// index order, and a point refused at MAX_DEPTH keeps its old position (see
+// keepRefused()). Both paths therefore end with the same points, all of them
+// in the tree at their position. Returns true if the tree was rebuilt.
+bool stepFrame(FrameTree *ft, Point *newPositions) {
+    int moved = 0;
+    for (int i = 0; i < ft->count; i++) {
+        Point *p = &ft->positions[i], *q = &newPositions[i];
+        if (p->x != q->x || p->y != q->y || p->z != q->z) moved++;
+    }
+    ft->frames++;
+    if (moved == 0) return false;
+
+    bool rebuild = moved >= ft->rebuildFraction * ft->count;
+    if (ft->adaptive) {
+        // Now and then take the other path so its cost does not go stale, unless
+        // it is expected to cost more than twice as much
+        double moveCost = ft->moveMs * moved, rebuildCost = ft->rebuildMs * ft->count;
+        bool close = rebuild ? moveCost <= 2.0 * rebuildCost : rebuildCost <= 2.0 * moveCost;
+        bool stale = ft->samePath >= FRAME_PROBE || ft->moveMs == 0.0;
+        if (stale && rebuild && ft->lastRebuilt && close) rebuild = false;
+        else if (stale && !rebuild && !ft->lastRebuilt && close) rebuild = true;
+        ft->samePath = rebuild == ft->lastRebuilt ? ft->samePath + 1 : 1;
+        ft->lastRebuilt = rebuild;
+    }
+
+    double start = frameClockMs();
+    int *movedIndices = (int *)malloc(2 * moved * sizeof(int));
+    bool *accepted = (bool *)malloc(ft->count * sizeof(bool));
+    if (!movedIndices || !accepted) {
+        perror("Failed to allocate memory for frame");
+        exit(EXIT_FAILURE);
+    }
+    int *refused = movedIndices + moved;
+    int refusedCount = 0;
+    for (int i = 0, m = 0; i < ft->count; i++) {
+        Point *p = &ft->positions[i], *q = &newPositions[i];
+        if (p->x != q->x || p->y != q->y || p->z != q->z) movedIndices[m++] = i;
+    }
+
+    if (rebuild) {
+        // Build the next frame's tree while queries use the current one, then swap.
+        // The unmoved points go first, so only moved points can be refused.
+        Point *order = (Point *)malloc(ft->count * sizeof(Point));
+        bool *orderRefused = (bool *)malloc(ft->count * sizeof(bool));
+        if (!order || !orderRefused) {
+            perror("Failed to allocate memory for rebuild");
+            exit(EXIT_FAILURE);
+        }
+        int unmoved = 0;
+        for (int i = 0, m = 0; i < ft->count; i++) {
+            if (m < moved && movedIndices[m] == i) m++;
+            else order[unmoved++] = ft->positions[i];
+        }
+        for (int m = 0; m < moved; m++) order[unmoved + m] = newPositions[movedIndices[m]];
+        OctreeNode *next = buildTree(order, ft->count, orderRefused);
+        for (int m = 0; m < moved; m++) {
+            accepted[movedIndices[m]] = !orderRefused[unmoved + m];
+            if (orderRefused[unmoved + m]) refused[refusedCount++] = movedIndices[m];
+        }
+        free(order);
+        free(orderRefused);
+        keepRefused(next, ft->positions, newPositions, movedIndices, moved, accepted, refused, refusedCount);
+
+        pthread_rwlock_wrlock(&ft->lock);
+        OctreeNode *old = ft->root;
+        ft->root = next;
+        for (int m = 0; m < moved; m++) {
+            if (accepted[movedIndices[m]]) ft->positions[movedIndices[m]] = newPositions[movedIndices[m]];
+        }
+        pthread_rwlock_unlock(&ft->lock);
+        freeTree(old);
+        free(movedIndices);
+        free(accepted);
+        ft->rebuilds++;
+        ft->rebuildMs = updateCost(ft->rebuildMs, (frameClockMs() - start) / ft->count);
+        adaptRebuildFraction(ft);
+        return true;
+    }
+
+    pthread_rwlock_wrlock(&ft->lock);
+    for (int m = 0; m < moved; m++) deletePoint_collision(ft->root, &ft->positions[movedIndices[m]]);
+    for (int m = 0; m < moved; m++) {
+        int i = movedIndices[m];
+        accepted[i] = insertPoint_collision(ft->root, &newPositions[i]);
+        if (!accepted[i]) refused[refusedCount++] = i;
+    }
+    keepRefused(ft->root, ft->positions, newPositions, movedIndices, moved, accepted, refused, refusedCount);
+    for (int m = 0; m < moved; m++) {
+        if (accepted[movedIndices[m]]) ft->positions[movedIndices[m]] = newPositions[movedIndices[m]];
+    }
+    pthread_rwlock_unlock(&ft->lock);
+    free(movedIndices);
+    free(accepted);
+    ft->moveMs = updateCost(ft->moveMs, (frameClockMs() - start) / moved);
+    adaptRebuildFraction(ft);
+    return false;
+}
+
+// Free all memory allocated for the frame tree
+void freeFrameTree(FrameTree *ft) {
+    if (ft) {
+        pthread_rwlock_destroy(&ft->lock);
+        freeTree(ft->root);
+        free(ft->positions);
+        free(ft);
+    }
+}
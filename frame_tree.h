@@ -0,0 +1,42 @@
+// frame_tree.h
+#ifndef FRAME_TREE_H
+#define FRAME_TREE_H
+
+#include <stdbool.h>
+#include <pthread.h>
+#include "octree.h"
+
+// Define constants
+#define REBUILD_FRACTION 0.9f   // Fraction of moved points from which a frame rebuilds the tree, until both costs are measured
+#define FRAME_COST_WEIGHT 0.25  // Weight of the latest frame in the measured costs
+#define FRAME_PROBE 16          // Frames in a row on one path after which the other is measured again
+
+// Octree over a fixed set of moving points, advanced one frame at a time.
+// A frame with few moved points is applied incrementally; otherwise a fresh
+// tree is built in parallel from the new positions while queries keep running
+// against the previous one, and the two are swapped at the end. With adaptive
+// set, rebuildFraction follows the measured cost of both kinds of frames.
+typedef struct FrameTree {
+    OctreeNode *root;          // Tree queries run against
+    pthread_rwlock_t lock;     // Held shared by queries, exclusively by updates and the swap
+    Point *positions;          // Current position of every point
+    int count;
+    float rebuildFraction;
+    bool adaptive;
+    double moveMs;             // Measured cost of moving one point incrementally, 0 if unknown
+    double rebuildMs;          // Measured cost per point of a rebuild
+    int samePath;              // Frames in a row that took the same path
+    bool lastRebuilt;
+    int frames;
+    int rebuilds;
+} FrameTree;
+
+// Function prototypes
+OctreeNode *buildTreeParallel(Point *positions, int count);
+FrameTree *createFrameTree(Point *positions, int count);
+OctreeNode *beginFrameQuery(FrameTree *ft);
+void endFrameQuery(FrameTree *ft);
+bool stepFrame(FrameTree *ft, Point *newPositions);
+void freeFrameTree(FrameTree *ft);
+
+#endif // FRAME_TREE_H
@@ -1,10 +1,11 @@
 // main.c
 #include "octree.h"
+#include "journal.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 // Function to handle the game loop for moving points
-void gameLoop(OctreeNode *root, Point *selectedPoint) {
+void gameLoop(OctreeNode *root, Point *selectedPoint, Journal *journal) {
     char command;
     OctreeNode *selectedNode = searchPoint(root, selectedPoint);
     if (selectedNode == NULL) {
@@ -94,7 +95,12 @@ void gameLoop(OctreeNode *root, Point *selectedPoint) {
             }
             else{
                 updatePointInTree(root, &oldPoint, selectedPoint);
-                printTree(root);
+                journalAppend(journal, JOURNAL_UPDATE, &oldPoint, selectedPoint);
+                // The whole tree is only rewritten at checkpoints, not after every move
+                if (journalCheckpointDue(journal)) {
+                    journalCheckpoint(journal, root);
+                    printTree(root);
+                }
             }
         }    
     }
@@ -104,10 +110,17 @@ int main() {
     // Initialize the root of the octree
     Point initialcenter = {0.0f, 0.0f, 0.0f};
     float size = MAX_SIZE;  // Arbitrary root size
-    OctreeNode *root = createNode(initialcenter, size, 0);
+    OctreeNode *root;
 
-    // Read points from file
-    readPoints("random1.txt", root);
+    // Recover the tree from the last checkpoint and the journal, or read the initial points
+    Journal *journal = openJournal(JOURNAL_FILE, CHECKPOINT_FILE, JOURNAL_SYNC_EVERY, &root);
+    if (root == NULL) {
+        root = createNode(initialcenter, size, 0);
+        readPoints("random1.txt", root);
+        journalCheckpoint(journal, root);
+    } else {
+        printf("Octree recovered from %s and %s\n", CHECKPOINT_FILE, JOURNAL_FILE);
+    }
 
     // Print the octree to Octree.txt
     printTree(root);    
@@ -118,6 +131,7 @@ int main() {
     printf("\nEnter initial point coordinates to select (x y z): ");
     if (scanf("%f %f %f", &selectedPoint.x, &selectedPoint.y, &selectedPoint.z) != 3) {
         fprintf(stderr, "Invalid input for point coordinates.\n");
+        closeJournal(journal);
         freeTree(root);
         return EXIT_FAILURE;
     }
@@ -128,8 +142,11 @@ int main() {
     if (selectedNode == NULL){
         printf("Point not found in the octree\n");
     } else{
-        gameLoop(root, &selectedPoint);
+        gameLoop(root, &selectedPoint, journal);
+        printTree(root);
     }
+    journalCheckpoint(journal, root);
+    closeJournal(journal);
     // Clear input buffer
     while (getchar() != '\n');
 
@@ -0,0 +1,274 @@
+// journal.c
+#include "journal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// File headers
+static const char JOURNAL_MAGIC[4] = {'O', 'C', 'T', 'J'};
+static const char CHECKPOINT_MAGIC[4] = {'O', 'C', 'T', 'C'};
+#define JOURNAL_VERSION 1
+
+// FNV-1a over the record with its checksum field cleared
+static uint32_t recordChecksum(JournalRecord *r) {
+    JournalRecord copy = *r;
+    copy.checksum = 0;
+    const unsigned char *bytes = (const unsigned char *)&copy;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Flush a stream and force it to disk
+static void syncFile(FILE *fp) {
+    fflush(fp);
+    fsync(fileno(fp));
+}
+
+// Force a rename in the directory holding path to disk
+static void syncDirectory(const char *path) {
+    char dir[JOURNAL_PATH_SIZE];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (slash == dir) slash[1] = '\0';
+    else if (slash) *slash = '\0';
+    else strcpy(dir, ".");
+    int fd = open(dir, O_RDONLY);
+    if (fd == -1) {
+        perror("Failed to open checkpoint directory");
+        return;
+    }
+    if (fsync(fd) != 0) perror("Failed to sync checkpoint directory");
+    close(fd);
+}
+
+static void writeHeader(FILE *fp, const char magic[4]) {
+    uint32_t version = JOURNAL_VERSION;
+    fwrite(magic, 1, 4, fp);
+    fwrite(&version, sizeof(version), 1, fp);
+}
+
+static bool readHeader(FILE *fp, const char magic[4]) {
+    char found[4];
+    uint32_t version;
+    return fread(found, 1, 4, fp) == 4 && memcmp(found, magic, 4) == 0 &&
+           fread(&version, sizeof(version), 1, fp) == 1 && version == JOURNAL_VERSION;
+}
+
+// Apply one mutation without printing, the way the original call changed the tree
+static void applyRecord(OctreeNode *root, JournalRecord *r) {
+    switch (r->op) {
+        case JOURNAL_INSERT:
+            insertPoint_collision(root, &r->oldPoint);
+            break;
+        case JOURNAL_DELETE:
+            deletePoint_collision(root, &r->oldPoint);
+            break;
+        case JOURNAL_UPDATE:
+            if (searchPoint(root, &r->oldPoint) == NULL) break;
+            deletePoint_collision(root, &r->oldPoint);
+            if (!insertPoint_collision(root, &r->newPoint)) {
+                insertPoint_collision(root, &r->oldPoint);  // Reverted, as updatePointInTree() does
+            }
+            break;
+    }
+}
+
+// Load the checkpoint into a new tree; returns NULL if there is none.
+// *seq is set to the last journal record the checkpoint includes.
+static OctreeNode *loadCheckpoint(const char *path, uint64_t *seq) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    uint64_t lastSeq;
+    uint32_t count;
+    if (!readHeader(fp, CHECKPOINT_MAGIC) ||
+        fread(&lastSeq, sizeof(lastSeq), 1, fp) != 1 ||
+        fread(&count, sizeof(count), 1, fp) != 1) {
+        fprintf(stderr, "Ignoring invalid checkpoint %s.\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, MAX_SIZE, 0);
+    Point p;
+    for (uint32_t i = 0; i < count && fread(&p, sizeof(Point), 1, fp) == 1; i++) {
+        insertPoint_collision(root, &p);
+    }
+    fclose(fp);
+    *seq = lastSeq;
+    return root;
+}
+
+// Replay the journal records newer than the checkpoint into *root (created if NULL).
+// Stops at the first torn or corrupt record and cuts the file there.
+static void replayJournal(const char *path, uint64_t checkpointSeq, OctreeNode **root, uint64_t *lastSeq) {
+    FILE *fp = fopen(path, "r+b");
+    if (!fp) return;
+    if (!readHeader(fp, JOURNAL_MAGIC)) {
+        fprintf(stderr, "Ignoring invalid journal %s.\n", path);
+        fclose(fp);
+        return;
+    }
+
+    long good = ftell(fp);
+    JournalRecord r;
+    int replayed = 0;
+    while (fread(&r, sizeof(r), 1, fp) == 1 && r.checksum == recordChecksum(&r)) {
+        good = ftell(fp);
+        if (r.seq <= checkpointSeq) continue;  // Already part of the checkpoint
+        if (*root == NULL) {
+            Point center = {0.0f, 0.0f, 0.0f};
+            *root = createNode(center, MAX_SIZE, 0);
+        }
+        applyRecord(*root, &r);
+        *lastSeq = r.seq;
+        replayed++;
+    }
+    if (ftruncate(fileno(fp), good) != 0) {
+        perror("Failed to cut the torn end of the journal");
+    }
+    fclose(fp);
+    printf("Replayed %d journal records from %s.\n", replayed, path);
+}
+
+// Open the journal, recovering the tree from the last checkpoint plus the journal tail.
+// *root is set to the recovered tree, or NULL when neither file holds any state.
+Journal *openJournal(const char *journalPath, const char *checkpointPath, JournalSync sync, OctreeNode **root) {
+    Journal *j = (Journal *)calloc(1, sizeof(Journal));
+    if (!j) {
+        perror("Failed to allocate memory for journal");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(j->journalPath, sizeof(j->journalPath), "%s", journalPath);
+    snprintf(j->checkpointPath, sizeof(j->checkpointPath), "%s", checkpointPath);
+    j->sync = sync;
+    j->checkpointEvery = JOURNAL_CHECKPOINT_RECORDS;
+
+    uint64_t checkpointSeq = 0;
+    *root = loadCheckpoint(checkpointPath, &checkpointSeq);
+    uint64_t lastSeq = checkpointSeq;
+    replayJournal(journalPath, checkpointSeq, root, &lastSeq);
+    j->nextSeq = lastSeq + 1;
+
+    // Append after the valid records, or start a new journal
+    j->fp = fopen(journalPath, "r+b");
+    bool valid = j->fp && readHeader(j->fp, JOURNAL_MAGIC);
+    if (!valid) {
+        if (j->fp) fclose(j->fp);
+        j->fp = fopen(journalPath, "w+b");
+        if (!j->fp) {
+            perror("Failed to open journal");
+            exit(EXIT_FAILURE);
+        }
+        writeHeader(j->fp, JOURNAL_MAGIC);
+        syncFile(j->fp);
+    }
+    fseek(j->fp, 0, SEEK_END);
+    return j;
+}
+
+// Write the buffered records in one go
+void journalCommit(Journal *j) {
+    if (j->buffered == 0) return;
+    if (fwrite(j->buffer, sizeof(JournalRecord), j->buffered, j->fp) != (size_t)j->buffered) {
+        perror("Failed to write journal");
+    }
+    if (j->sync == JOURNAL_SYNC_NONE) {
+        fflush(j->fp);
+    } else {
+        syncFile(j->fp);
+    }
+    j->buffered = 0;
+}
+
+// Log one mutation; it becomes durable at the next group commit
+void journalAppend(Journal *j, JournalOp op, Point *oldPoint, Point *newPoint) {
+    JournalRecord *r = &j->buffer[j->buffered++];
+    memset(r, 0, sizeof(*r));
+    r->op = op;
+    r->seq = j->nextSeq++;
+    r->oldPoint = *oldPoint;
+    if (newPoint) r->newPoint = *newPoint;
+    r->checksum = recordChecksum(r);
+    j->sinceCheckpoint++;
+
+    if (j->buffered == JOURNAL_GROUP || j->sync == JOURNAL_SYNC_EVERY) {
+        journalCommit(j);
+    }
+}
+
+// Check if enough records have been logged since the last checkpoint
+bool journalCheckpointDue(Journal *j) {
+    return j->sinceCheckpoint >= j->checkpointEvery;
+}
+
+// Write every point of the tree to the checkpoint file
+static void writeCheckpointPoints(OctreeNode *node, FILE *fp, uint32_t *count) {
+    if (node == NULL) return;
+    if (node->isLeaf) {
+        fwrite(node->points, sizeof(Point), node->ptCount, fp);
+        *count += node->ptCount;
+    } else {
+        for (int i = 0; i < 8; i++) {
+            writeCheckpointPoints(node->children[i], fp, count);
+        }
+    }
+}
+
+// Save the whole tree and empty the journal.
+// The checkpoint is written to a temporary file and renamed, so a crash leaves
+// either the old or the new checkpoint; records it already holds are skipped on replay.
+void journalCheckpoint(Journal *j, OctreeNode *root) {
+    journalCommit(j);
+
+    char tmpPath[JOURNAL_PATH_SIZE + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", j->checkpointPath);
+    FILE *fp = fopen(tmpPath, "wb");
+    if (!fp) {
+        perror("Failed to open checkpoint for writing");
+        return;
+    }
+    uint64_t lastSeq = j->nextSeq - 1;
+    uint32_t count = 0;
+    writeHeader(fp, CHECKPOINT_MAGIC);
+    fwrite(&lastSeq, sizeof(lastSeq), 1, fp);
+    long countOffset = ftell(fp);
+    fwrite(&count, sizeof(count), 1, fp);
+    writeCheckpointPoints(root, fp, &count);
+    fseek(fp, countOffset, SEEK_SET);
+    fwrite(&count, sizeof(count), 1, fp);
+    syncFile(fp);
+    fclose(fp);
+    if (rename(tmpPath, j->checkpointPath) != 0) {
+        perror("Failed to install checkpoint");
+        return;
+    }
+    // The journal may only be emptied once the new checkpoint is sure to be found
+    syncDirectory(j->checkpointPath);
+
+    // Start an empty journal
+    fflush(j->fp);
+    if (ftruncate(fileno(j->fp), 0) != 0) {
+        perror("Failed to truncate journal");
+        return;
+    }
+    rewind(j->fp);
+    writeHeader(j->fp, JOURNAL_MAGIC);
+    syncFile(j->fp);
+    j->sinceCheckpoint = 0;
+}
+
+// Commit pending records and close the journal
+void closeJournal(Journal *j) {
+    if (j) {
+        journalCommit(j);
+        if (j->sync != JOURNAL_SYNC_NONE) syncFile(j->fp);
+        fclose(j->fp);
+        free(j);
+    }
+}
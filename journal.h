@@ -0,0 +1,62 @@
+// journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "octree.h"
+
+// Define constants
+#define JOURNAL_FILE "Octree.journal"      // Default journal of mutations since the last checkpoint
+#define CHECKPOINT_FILE "Octree.ckpt"      // Default checkpoint holding every point of the tree
+#define JOURNAL_GROUP 64                   // Records buffered before a group commit
+#define JOURNAL_CHECKPOINT_RECORDS 1000    // Records after which a checkpoint is due
+#define JOURNAL_PATH_SIZE 256
+
+// Kind of mutation a record describes
+typedef enum JournalOp {
+    JOURNAL_INSERT = 1,
+    JOURNAL_DELETE = 2,
+    JOURNAL_UPDATE = 3
+} JournalOp;
+
+// When the journal is forced to disk
+typedef enum JournalSync {
+    JOURNAL_SYNC_NONE,     // Left to the operating system
+    JOURNAL_SYNC_COMMIT,   // fsync at every group commit
+    JOURNAL_SYNC_EVERY     // Commit and fsync after every record
+} JournalSync;
+
+// Fixed-size binary record, written in host byte order.
+// Insert and delete use oldPoint only, update moves oldPoint to newPoint.
+typedef struct JournalRecord {
+    uint32_t op;
+    uint32_t checksum;   // Detects a record torn by a crash
+    uint64_t seq;        // Increasing sequence number, compared with the checkpoint's
+    Point oldPoint;
+    Point newPoint;
+} JournalRecord;
+
+// Append-only journal of tree mutations with periodic checkpoints
+typedef struct Journal {
+    FILE *fp;
+    char journalPath[JOURNAL_PATH_SIZE];
+    char checkpointPath[JOURNAL_PATH_SIZE];
+    JournalSync sync;
+    JournalRecord buffer[JOURNAL_GROUP];
+    int buffered;
+    uint64_t nextSeq;
+    int sinceCheckpoint;
+    int checkpointEvery;
+} Journal;
+
+// Function prototypes
+Journal *openJournal(const char *journalPath, const char *checkpointPath, JournalSync sync, OctreeNode **root);
+void journalAppend(Journal *j, JournalOp op, Point *oldPoint, Point *newPoint);
+void journalCommit(Journal *j);
+bool journalCheckpointDue(Journal *j);
+void journalCheckpoint(Journal *j, OctreeNode *root);
+void closeJournal(Journal *j);
+
+#endif // JOURNAL_H
@@ -1,4 +1,5 @@
 from .point import Point
+from .query_cache import QueryCache, next_version
 import math
 
 # Constants from your original project
@@ -16,6 +17,7 @@ class OctreeNode:
         self.points = []
         self.children = [None] * 8
         self.pt_count = 0
+        self.version = next_version()  # Renewed by every insert and delete below this node
         
         # Calculate min and max bounds
         half_size = size / 2
@@ -60,6 +62,7 @@ class OctreeNode:
 
     def insert(self, point):
         """Insert a point into the octree"""
+        self.version = next_version()
         if self.is_leaf:
             if len(self.points) < MAX_POINTS or self.depth >= MAX_DEPTH:
                 self.points.append(point)
@@ -97,6 +100,7 @@ class OctreeNode:
 
     def delete(self, point):
         """Delete a point from the octree"""
+        self.version = next_version()
         if self.is_leaf:
             for i, p in enumerate(self.points):
                 if p == point:
@@ -195,6 +199,7 @@ class Octree:
         if center is None:
             center = Point(0, 0, 0)
         self.root = OctreeNode(center, size, 0)
+        self.cache = QueryCache()  # Repeated range and nearest queries are answered from here
 
     def insert(self, point):
         """Insert a point into the octree"""
@@ -210,11 +215,11 @@ class Octree:
 
     def range_query(self, min_point, max_point):
         """Find all points within a range"""
-        return self.root.range_query(min_point, max_point)
+        return self.cache.range_query(self.root, min_point, max_point)
 
     def find_nearest_neighbor(self, target):
         """Find the nearest neighbor to a target point"""
-        best_point, best_distance = self.root.find_nearest_neighbor(target)
+        best_point, best_distance = self.cache.nearest_neighbor(self.root, target)
         return best_point
 
     def get_all_points(self):
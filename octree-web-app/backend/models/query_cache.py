@@ -0,0 +1,129 @@
+from .point import Point
+from collections import OrderedDict
+import itertools
+
+# Same scheme as query_cache.c in the C project
+CACHE_ENTRIES = 64
+
+_versions = itertools.count(1)
+
+
+def next_version():
+    """New modification stamp for the nodes along an insert or delete path"""
+    return next(_versions)
+
+
+def _containing_octant(node, min_point, max_point):
+    """Octant of node whose routing region holds the whole box, or -1 if the box spans several"""
+    octant = 0
+    for low, high, center, bit in ((min_point.x, max_point.x, node.center.x, 4),
+                                   (min_point.y, max_point.y, node.center.y, 2),
+                                   (min_point.z, max_point.z, node.center.z, 1)):
+        if low >= center:
+            octant |= bit
+        elif high >= center:
+            return -1
+    return octant
+
+
+def _octant_intersects(node, octant, min_point, max_point):
+    """Check if the box reaches into the routing region of a child octant"""
+    for low, high, center, bit in ((min_point.x, max_point.x, node.center.x, 4),
+                                   (min_point.y, max_point.y, node.center.y, 2),
+                                   (min_point.z, max_point.z, node.center.z, 1)):
+        if (high < center) if octant & bit else (low >= center):
+            return False
+    return True
+
+
+class CacheEntry:
+    """A cached query result together with the subtree stamps it depends on.
+
+    The entry remembers the octants leading from the root to the smallest node
+    containing the query box, and the versions of that node's children that the
+    box reaches (or of the node itself when it is a leaf). The result is still
+    valid as long as the path exists and none of those versions have changed.
+    """
+
+    def __init__(self, root, min_point, max_point, result):
+        self.result = result
+        self.path = []
+        node = root
+        while not node.is_leaf:
+            octant = _containing_octant(node, min_point, max_point)
+            if octant == -1:
+                break
+            self.path.append(octant)
+            node = node.children[octant]
+        self.cover_is_leaf = node.is_leaf
+        if node.is_leaf:
+            self.stamps = [(None, node.version)]
+        else:
+            self.stamps = [(i, node.children[i].version) for i in range(8)
+                           if _octant_intersects(node, i, min_point, max_point)]
+
+    def valid(self, root):
+        """Follow the recorded path and compare the stamps, without re-running the query"""
+        node = root
+        for octant in self.path:
+            if node.is_leaf:
+                return False
+            node = node.children[octant]
+        if node.is_leaf != self.cover_is_leaf:
+            return False
+        if node.is_leaf:
+            return node.version == self.stamps[0][1]
+        return all(node.children[octant].version == version for octant, version in self.stamps)
+
+
+class QueryCache:
+    """Range query and nearest neighbor results of an Octree, keyed by the query parameters"""
+
+    def __init__(self, entries=CACHE_ENTRIES):
+        self.entries = OrderedDict()
+        self.capacity = entries
+        self.hits = 0
+        self.misses = 0
+
+    def _lookup(self, key, root):
+        entry = self.entries.get(key)
+        if entry is not None and entry.valid(root):
+            self.hits += 1
+            self.entries.move_to_end(key)
+            return entry
+        self.misses += 1
+        return None
+
+    def _store(self, key, entry):
+        self.entries[key] = entry
+        self.entries.move_to_end(key)
+        if len(self.entries) > self.capacity:
+            self.entries.popitem(last=False)
+
+    def range_query(self, root, min_point, max_point):
+        """Points with min_point <= p <= max_point, served from the cache when no touched subtree changed"""
+        key = ("range", min_point.x, min_point.y, min_point.z, max_point.x, max_point.y, max_point.z)
+        entry = self._lookup(key, root)
+        if entry is None:
+            entry = CacheEntry(root, min_point, max_point, root.range_query(min_point, max_point))
+            self._store(key, entry)
+        return list(entry.result)
+
+    def nearest_neighbor(self, root, target):
+        """(nearest point, distance), served from the cache when no touched subtree changed.
+        The result only depends on the points within that distance of the target, so the
+        entry stamps the box of that radius (the whole tree when nothing was found)."""
+        key = ("nearest", target.x, target.y, target.z)
+        entry = self._lookup(key, root)
+        if entry is None:
+            best_point, best_distance = root.find_nearest_neighbor(target)
+            # Widen slightly so rounding cannot leave the neighbor outside the box
+            reach = best_distance * 1.0001 + 0.001 if best_point is not None else float('inf')
+            entry = CacheEntry(root, Point(target.x - reach, target.y - reach, target.z - reach),
+                               Point(target.x + reach, target.y + reach, target.z + reach),
+                               (best_point, best_distance))
+            self._store(key, entry)
+        return entry.result
+
+    def clear(self):
+        self.entries.clear()
@@ -0,0 +1,357 @@
+from .point import Point
+from .octree import MAX_POINTS, COLLISION_SIZE
+from .query_cache import CACHE_ENTRIES
+from collections import OrderedDict
+import ctypes
+import os
+import socket
+import struct
+import threading
+
+# Must match octree_daemon.h and shm_tree.h in the C project
+DAEMON_SOCKET = "/tmp/octree.sock"
+SHM_TREE_NAME = "/octree_shm"
+DAEMON_MAX_BATCH = 4096
+DAEMON_BAD_REQUEST = 0xffffffff
+
+DAEMON_INSERT = 1
+DAEMON_DELETE = 2
+DAEMON_MOVE = 3
+DAEMON_SEARCH = 4
+DAEMON_RANGE = 5
+DAEMON_NEAREST = 6
+
+DAEMON_DONE = 0
+DAEMON_DUPLICATE = 1
+DAEMON_NOT_FOUND = 2
+DAEMON_FAILED = 3
+DAEMON_FULL = 4
+
+SHM_TREE_GONE = -1
+
+HEADER = struct.Struct("=II")
+POINT = struct.Struct("=3f")
+NEAREST = struct.Struct("=I3ff")
+COUNT = struct.Struct("=I")
+
+DEFAULT_LIBRARY = os.path.join(os.path.dirname(__file__), '..', '..', '..', 'libshmtree.so')
+
+
+class CPoint(ctypes.Structure):
+    _fields_ = [("x", ctypes.c_float), ("y", ctypes.c_float), ("z", ctypes.c_float)]
+
+
+class ShmNode(ctypes.Structure):
+    _fields_ = [
+        ("center", CPoint),
+        ("size", ctypes.c_float),          # Half the edge of the cube
+        ("depth", ctypes.c_int),
+        ("isLeaf", ctypes.c_int),
+        ("ptCount", ctypes.c_int),
+        ("children", ctypes.c_int),
+        ("version", ctypes.c_ulong),
+        ("points", CPoint * MAX_POINTS),
+    ]
+
+
+def load_library(path=None):
+    """Load libshmtree.so and declare the reader functions"""
+    lib = ctypes.CDLL(path or os.environ.get('OCTREE_SHM_LIBRARY', DEFAULT_LIBRARY))
+    if lib.shmNodeSize() != ctypes.sizeof(ShmNode):
+        raise RuntimeError("libshmtree.so was built with a different MAX_POINTS or layout")
+    point_p = ctypes.POINTER(CPoint)
+    lib.attachShmTree.argtypes = [ctypes.c_char_p]
+    lib.attachShmTree.restype = ctypes.c_void_p
+    lib.detachShmTree.argtypes = [ctypes.c_void_p]
+    lib.shmPointCount.argtypes = [ctypes.c_void_p]
+    lib.shmSequence.argtypes = [ctypes.c_void_p]
+    lib.shmSequence.restype = ctypes.c_long
+    lib.shmSearch.argtypes = [ctypes.c_void_p, point_p]
+    lib.shmRangeQuery.argtypes = [ctypes.c_void_p, point_p, point_p, point_p, ctypes.c_int]
+    lib.shmRadiusQuery.argtypes = [ctypes.c_void_p, point_p, ctypes.c_float, point_p, ctypes.c_int]
+    lib.shmNearestNeighbor.argtypes = [ctypes.c_void_p, point_p, ctypes.c_bool, point_p, ctypes.POINTER(ctypes.c_float)]
+    lib.shmSnapshot.argtypes = [ctypes.c_void_p, ctypes.POINTER(ShmNode), ctypes.c_int]
+    return lib
+
+
+def _to_c(point):
+    return CPoint(point.x, point.y, point.z)
+
+
+def _from_c(point):
+    return Point(point.x, point.y, point.z)
+
+
+class SharedOctree:
+    """Octree owned by octree_daemon and shared by every worker process.
+
+    Queries read the daemon's shared memory segment directly without a lock or a
+    round trip. Changes are sent to the daemon over its Unix domain socket, so all
+    workers see the same tree. Batched calls send up to DAEMON_MAX_BATCH records
+    in one request. Range and nearest neighbor results are kept while the
+    segment's sequence shows no write since they were read.
+    """
+
+    def __init__(self, socket_path=None, shm_name=None, library=None):
+        self.socket_path = socket_path or os.environ.get('OCTREE_DAEMON_SOCKET', DAEMON_SOCKET)
+        self.shm_name = shm_name or os.environ.get('OCTREE_SHM_NAME', SHM_TREE_NAME)
+        self.library = library
+        self._lib = None
+        self._lock = threading.Lock()
+        self._pid = None
+        self._tree = None
+        self._socket = None
+        self._stale = []
+        self._cache = OrderedDict()   # Query parameters -> (segment, sequence, result)
+        self._cache_lock = threading.Lock()
+        self.hits = 0
+        self.misses = 0
+
+    # The segment and the socket are opened on first use in each process, so an
+    # instance created before gunicorn forks its workers is safe to use in all of them.
+    def _attach(self):
+        if self._pid != os.getpid():
+            self._lib = self._lib or load_library(self.library)
+            self._tree = self._lib.attachShmTree(self.shm_name.encode())
+            if not self._tree:
+                raise RuntimeError(f"Shared octree {self.shm_name} not found, is octree_daemon running?")
+            self._socket = None
+            self._cache.clear()
+            self._pid = os.getpid()
+        return self._lib, self._tree
+
+    def _reattach(self, stale):
+        """Map the segment again after the daemon closed it or died"""
+        with self._lock:
+            if self._tree == stale and self._pid == os.getpid():
+                tree = self._lib.attachShmTree(self.shm_name.encode())
+                if not tree:
+                    raise RuntimeError(f"Shared octree {self.shm_name} not found, is octree_daemon running?")
+                # Other threads may still be reading the old mapping, so it is only unmapped by close()
+                self._stale.append(stale)
+                self._tree = tree
+                self._cache.clear()
+                if self._socket is not None:
+                    self._socket.close()
+                    self._socket = None
+            return self._lib, self._tree
+
+    def _read(self, call):
+        """Run call(lib, tree) on the segment, attaching again if it was replaced"""
+        lib, tree = self._attach()
+        result = call(lib, tree)
+        if result == SHM_TREE_GONE:
+            result = call(*self._reattach(tree))
+            if result == SHM_TREE_GONE:
+                raise RuntimeError(f"Shared octree {self.shm_name} is closed, is octree_daemon running?")
+        return result
+
+    def _cached(self, key, query):
+        """Result of query(), reused while no write reached the segment since it was read"""
+        sequence = self._read(lambda lib, tree: lib.shmSequence(tree))
+        tree = self._tree
+        with self._cache_lock:
+            hit = self._cache.get(key)
+            if hit is not None and hit[0] == tree and hit[1] == sequence:
+                self.hits += 1
+                self._cache.move_to_end(key)
+                return hit[2]
+            self.misses += 1
+        result = query()
+        # Only keep it if no write started while the query ran
+        if self._tree == tree and self._read(lambda lib, tree: lib.shmSequence(tree)) == sequence:
+            with self._cache_lock:
+                self._cache[key] = (tree, sequence, result)
+                self._cache.move_to_end(key)
+                if len(self._cache) > CACHE_ENTRIES:
+                    self._cache.popitem(last=False)
+        return result
+
+    def _connect(self):
+        self._attach()
+        if self._socket is None:
+            self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._socket.connect(self.socket_path)
+        return self._socket
+
+    def close(self):
+        with self._lock:
+            if self._pid == os.getpid():
+                if self._socket is not None:
+                    self._socket.close()
+                for tree in self._stale + [self._tree]:
+                    self._lib.detachShmTree(tree)
+            self._pid = self._tree = self._socket = None
+            self._stale = []
+            self._cache.clear()
+
+    def _receive(self, size):
+        data = bytearray()
+        while len(data) < size:
+            chunk = self._socket.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError("octree_daemon closed the connection")
+            data += chunk
+        return bytes(data)
+
+    def _request(self, op, records, per_record):
+        """Send one request per DAEMON_MAX_BATCH records and yield each reply"""
+        with self._lock:
+            try:
+                self._connect()
+                for start in range(0, len(records), DAEMON_MAX_BATCH):
+                    chunk = records[start:start + DAEMON_MAX_BATCH]
+                    body = b"".join(POINT.pack(p.x, p.y, p.z) for record in chunk
+                                    for p in (record if per_record == 2 else (record,)))
+                    self._socket.sendall(HEADER.pack(op, len(chunk)) + body)
+                    reply_op, count = HEADER.unpack(self._receive(HEADER.size))
+                    if reply_op == DAEMON_BAD_REQUEST:
+                        raise ValueError("octree_daemon rejected the request")
+                    yield from self._read_reply(op, count)
+            except (OSError, ValueError):
+                if self._socket is not None:
+                    self._socket.close()
+                self._socket = None
+                raise
+
+    def _read_reply(self, op, count):
+        if op == DAEMON_NEAREST:
+            data = self._receive(count * NEAREST.size)
+            for i in range(count):
+                found, x, y, z, distance = NEAREST.unpack_from(data, i * NEAREST.size)
+                yield (Point(x, y, z), distance) if found else (None, float('inf'))
+        elif op == DAEMON_RANGE:
+            for _ in range(count):
+                (n,) = COUNT.unpack(self._receive(COUNT.size))
+                data = self._receive(n * POINT.size)
+                yield [Point(*POINT.unpack_from(data, i * POINT.size)) for i in range(n)]
+        else:
+            yield from self._receive(count)
+
+    # Batched operations, one result per record
+    def insert_many(self, points):
+        """Insert points, returning a DAEMON_* status per point"""
+        return list(self._request(DAEMON_INSERT, list(points), 1))
+
+    def delete_many(self, points):
+        return list(self._request(DAEMON_DELETE, list(points), 1))
+
+    def move_many(self, moves):
+        """Move (old_point, new_point) pairs"""
+        return list(self._request(DAEMON_MOVE, list(moves), 2))
+
+    def search_many(self, points):
+        return [status == DAEMON_DONE for status in self._request(DAEMON_SEARCH, list(points), 1)]
+
+    def range_query_many(self, boxes):
+        """Points inside each (min_point, max_point) box"""
+        return list(self._request(DAEMON_RANGE, list(boxes), 2))
+
+    def nearest_many(self, targets):
+        """(nearest point, distance) per target, (None, inf) for an empty tree"""
+        return list(self._request(DAEMON_NEAREST, list(targets), 1))
+
+    # Same interface as Octree
+    def insert(self, point):
+        """Insert a point; False if it is already there or its cell is full"""
+        return self.insert_many([point])[0] == DAEMON_DONE
+
+    def delete(self, point):
+        return self.delete_many([point])[0] == DAEMON_DONE
+
+    def update_point(self, old_point, new_point):
+        """Move a point; it stays where it was if the move fails"""
+        return self.move_many([(old_point, new_point)])[0] == DAEMON_DONE
+
+    def search(self, point):
+        target = _to_c(point)
+        return point if self._read(lambda lib, tree: lib.shmSearch(tree, ctypes.byref(target))) == 1 else None
+
+    def range_query(self, min_point, max_point):
+        """Find all points with min_point <= p <= max_point"""
+        low, high = _to_c(min_point), _to_c(max_point)
+
+        def query():
+            capacity = 64
+            while True:
+                out = (CPoint * capacity)()
+                n = self._read(lambda lib, tree: lib.shmRangeQuery(tree, ctypes.byref(low), ctypes.byref(high), out, capacity))
+                if n <= capacity:
+                    return [_from_c(out[i]) for i in range(n)]
+                capacity = n * 2
+
+        key = ("range", low.x, low.y, low.z, high.x, high.y, high.z)
+        return list(self._cached(key, query))
+
+    def find_nearest_neighbor(self, target):
+        point = _to_c(target)
+
+        def query():
+            nearest = CPoint()
+            distance = ctypes.c_float()
+            if self._read(lambda lib, tree: lib.shmNearestNeighbor(tree, ctypes.byref(point), False,
+                                                                   ctypes.byref(nearest), ctypes.byref(distance))) == 1:
+                return _from_c(nearest)
+            return None
+
+        return self._cached(("nearest", point.x, point.y, point.z), query)
+
+    def get_all_points(self):
+        """Get all points in the octree"""
+        nodes = self._snapshot()
+        points = []
+        pending = [0]
+        while pending:
+            node = nodes[pending.pop()]
+            if node.children < 0:
+                points.extend(_from_c(p) for p in node.points[:node.ptCount])
+            else:
+                pending.extend(node.children + i for i in range(8))
+        return points
+
+    def point_count(self):
+        return self._read(lambda lib, tree: lib.shmPointCount(tree))
+
+    def detect_collision(self, point, collision_size=COLLISION_SIZE):
+        """Detect collision with nearby points"""
+        half_size = collision_size / 2
+        min_point = Point(point.x - half_size, point.y - half_size, point.z - half_size)
+        max_point = Point(point.x + half_size, point.y + half_size, point.z + half_size)
+        for nearby_point in self.range_query(min_point, max_point):
+            if nearby_point != point and point.distance_to(nearby_point) < collision_size:
+                return True
+        return False
+
+    def _snapshot(self):
+        """Consistent copy of the segment's nodes; only those reachable from nodes[0] are in the tree"""
+        capacity = 1024
+        while True:
+            nodes = (ShmNode * capacity)()
+            used = self._read(lambda lib, tree: lib.shmSnapshot(tree, nodes, capacity))
+            if used <= capacity:
+                return nodes[:used]
+            capacity = used * 2
+
+    def to_dict(self):
+        """Convert octree to dictionary for JSON serialization, in the same format as
+        Octree.to_dict: size is the full edge of the cell (twice the C half edge)"""
+        nodes = self._snapshot()
+
+        def node_dict(node):
+            size = 2 * node.size
+            half = node.size
+            center = _from_c(node.center)
+            leaf = node.children < 0
+            return {
+                "center": center.to_dict(),
+                "size": size,
+                "depth": node.depth,
+                "is_leaf": leaf,
+                "points": [_from_c(p).to_dict() for p in node.points[:node.ptCount]] if leaf else [],
+                "pt_count": node.ptCount,
+                "min": Point(center.x - half, center.y - half, center.z - half).to_dict(),
+                "max": Point(center.x + half, center.y + half, center.z + half).to_dict(),
+                "children": [] if leaf else [node_dict(nodes[node.children + i]) for i in range(8)],
+            }
+
+        return node_dict(nodes[0])
@@ -1,17 +1,22 @@
 from flask import Blueprint, request, jsonify
 from models.octree import Octree
+from models.shared_octree import SharedOctree
 from models.point import Point
 from utils.file_operations import read_points_from_file
 import os
 
 octree_bp = Blueprint('octree_bp', __name__)
 
-# Initialize global octree
-octree = Octree()
+# With OCTREE_DAEMON_SOCKET set, every worker process uses the tree of octree_daemon
+# (started with -p random1.txt); otherwise each process keeps its own octree.
+if os.environ.get('OCTREE_DAEMON_SOCKET'):
+    octree = SharedOctree()
+else:
+    octree = Octree()
 
 # Load initial points
 initial_points_file = os.path.join(os.path.dirname(__file__), '..', 'static', 'data', 'random1.txt')
-if os.path.exists(initial_points_file):
+if isinstance(octree, Octree) and os.path.exists(initial_points_file):
     points_data = read_points_from_file(initial_points_file)
     for point_data in points_data:
         point = Point(point_data['x'], point_data['y'], point_data['z'])
@@ -0,0 +1,49 @@
+import random
+from backend.models.octree import Octree
+from backend.models.point import Point
+
+
+def test_repeated_range_query_is_cached():
+    octree = Octree(center=Point(0, 0, 0), size=1000)
+    for p in [Point(10, 10, 10), Point(-200, 100, 50), Point(300, -300, 300), Point(-100, -100, -100)]:
+        octree.insert(p)
+    low, high = Point(0, 0, 0), Point(50, 50, 50)
+    assert octree.range_query(low, high) == [Point(10, 10, 10)]
+    assert octree.range_query(low, high) == [Point(10, 10, 10)]
+    assert octree.cache.hits == 1
+
+    # A change in a subtree the box does not reach keeps the entry
+    octree.insert(Point(-400, -400, -400))
+    assert octree.range_query(low, high) == [Point(10, 10, 10)]
+    assert octree.cache.hits == 2
+
+    # A change inside it is seen
+    octree.insert(Point(20, 20, 20))
+    assert sorted(map(repr, octree.range_query(low, high))) == sorted(map(repr, [Point(10, 10, 10), Point(20, 20, 20)]))
+    assert octree.cache.hits == 2
+    octree.delete(Point(10, 10, 10))
+    assert octree.range_query(low, high) == [Point(20, 20, 20)]
+
+
+def test_cached_results_match_fresh_queries():
+    rng = random.Random(11)
+    octree = Octree(center=Point(0, 0, 0), size=1000)
+    points = []
+    boxes = []
+    for _ in range(20):
+        low = Point(rng.uniform(-500, 400), rng.uniform(-500, 400), rng.uniform(-500, 400))
+        boxes.append((low, Point(low.x + 100, low.y + 100, low.z + 100)))
+    targets = [Point(rng.uniform(-500, 500), rng.uniform(-500, 500), rng.uniform(-500, 500)) for _ in range(20)]
+
+    for _ in range(300):
+        if points and rng.random() < 0.3:
+            octree.delete(points.pop(rng.randrange(len(points))))
+        else:
+            p = Point(rng.uniform(-500, 500), rng.uniform(-500, 500), rng.uniform(-500, 500))
+            if octree.insert(p):
+                points.append(p)
+        for low, high in rng.sample(boxes, 3):
+            assert sorted(map(repr, octree.range_query(low, high))) == sorted(map(repr, octree.root.range_query(low, high)))
+        for target in rng.sample(targets, 3):
+            assert octree.find_nearest_neighbor(target) == octree.root.find_nearest_neighbor(target)[0]
+    assert octree.cache.hits > 0
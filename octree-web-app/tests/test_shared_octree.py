@@ -0,0 +1,212 @@
+import os
+import random
+import shutil
+import signal
+import socket
+import stat
+import struct
+import subprocess
+import sys
+import pytest
+from backend.models.shared_octree import SharedOctree, DAEMON_DONE, DAEMON_DUPLICATE, DAEMON_NOT_FOUND
+from backend.models.point import Point
+
+C_SOURCES = os.path.join(os.path.dirname(__file__), '..', '..')
+
+pytestmark = pytest.mark.skipif(not sys.platform.startswith('linux') or shutil.which('gcc') is None,
+                                reason="needs Linux and gcc to build octree_daemon")
+
+
+@pytest.fixture(scope="module")
+def build(tmp_path_factory):
+    """Build octree_daemon and libshmtree.so"""
+    tmp = tmp_path_factory.mktemp("build")
+    sources = [os.path.join(C_SOURCES, name) for name in ("octree.c", "journal.c", "shm_tree.c", "octree_daemon.c")]
+    subprocess.run(["gcc", "-O2", "-o", str(tmp / "octree_daemon")] + sources + ["-lm", "-pthread", "-lrt"], check=True)
+    subprocess.run(["gcc", "-O2", "-shared", "-fPIC", "-o", str(tmp / "libshmtree.so"), sources[2], "-lm", "-lrt"], check=True)
+    return tmp
+
+
+def start_daemon(build, workdir, socket_path, shm_name):
+    process = subprocess.Popen([str(build / "octree_daemon"), "-s", socket_path, "-m", shm_name],
+                               cwd=workdir, stdout=subprocess.PIPE, text=True)
+    for line in process.stdout:
+        if line.startswith("Serving"):
+            break
+    return process
+
+
+def stop_daemon(process):
+    process.send_signal(signal.SIGTERM)
+    assert process.wait(timeout=10) == 0
+
+
+@pytest.fixture(scope="module")
+def daemon(build, tmp_path_factory):
+    """Start the daemon with an empty tree"""
+    tmp = tmp_path_factory.mktemp("daemon")
+    socket_path = str(tmp / "octree.sock")
+    shm_name = f"/octree_test_{os.getpid()}"
+    process = start_daemon(build, tmp, socket_path, shm_name)
+    yield {"socket": socket_path, "shm": shm_name, "library": str(build / "libshmtree.so")}
+    stop_daemon(process)
+
+
+@pytest.fixture
+def tree(daemon):
+    octree = SharedOctree(daemon["socket"], daemon["shm"], daemon["library"])
+    octree.delete_many(octree.get_all_points())
+    yield octree
+    octree.close()
+
+
+def test_insert_search_delete(tree):
+    point = Point(10, 10, 10)
+    assert tree.insert(point)
+    assert not tree.insert(point)
+    assert tree.search(point) == point
+    assert tree.delete(point)
+    assert tree.search(point) is None
+    assert not tree.delete(point)
+
+
+def test_batch_statuses(tree):
+    points = [Point(100 * i - 450, -90 * i, 45 * i) for i in range(10)]
+    assert tree.insert_many(points + points[:2]) == [DAEMON_DONE] * 10 + [DAEMON_DUPLICATE] * 2
+    assert tree.point_count() == 10
+    assert tree.search_many(points[:3] + [Point(500, 500, 500)]) == [True, True, True, False]
+    assert tree.delete_many([points[0], Point(500, 500, 500)]) == [DAEMON_DONE, DAEMON_NOT_FOUND]
+
+
+def test_queries_match_brute_force(tree):
+    rng = random.Random(7)
+    points = [Point(rng.randint(-999, 999), rng.randint(-999, 999), rng.randint(-999, 999)) for _ in range(3000)]
+    inserted = [p for p, status in zip(points, tree.insert_many(points)) if status == DAEMON_DONE]
+    assert sorted(map(repr, tree.get_all_points())) == sorted(map(repr, inserted))
+
+    boxes = []
+    for _ in range(50):
+        low = Point(rng.randint(-999, 800), rng.randint(-999, 800), rng.randint(-999, 800))
+        boxes.append((low, Point(low.x + 200, low.y + 200, low.z + 200)))
+    by_socket = tree.range_query_many(boxes)
+    for (low, high), found in zip(boxes, by_socket):
+        expected = [p for p in inserted if low.x <= p.x <= high.x and low.y <= p.y <= high.y and low.z <= p.z <= high.z]
+        assert sorted(map(repr, tree.range_query(low, high))) == sorted(map(repr, expected))
+        assert sorted(map(repr, found)) == sorted(map(repr, expected))
+
+    targets = [Point(rng.uniform(-999, 999), rng.uniform(-999, 999), rng.uniform(-999, 999)) for _ in range(50)]
+    for target, (nearest, distance) in zip(targets, tree.nearest_many(targets)):
+        best = min(target.distance_to(p) for p in inserted)
+        assert tree.find_nearest_neighbor(target).distance_to(target) == pytest.approx(best, rel=1e-5)
+        assert distance == pytest.approx(best, rel=1e-5)
+
+
+def test_repeated_queries_are_cached_until_a_write(tree):
+    tree.insert_many([Point(10, 10, 10), Point(-300, 200, 100)])
+    low, high = Point(0, 0, 0), Point(50, 50, 50)
+    assert tree.range_query(low, high) == [Point(10, 10, 10)]
+    hits = tree.hits
+    assert tree.range_query(low, high) == [Point(10, 10, 10)]
+    assert tree.find_nearest_neighbor(Point(-290, 200, 100)) == Point(-300, 200, 100)
+    assert tree.find_nearest_neighbor(Point(-290, 200, 100)) == Point(-300, 200, 100)
+    assert tree.hits == hits + 2
+
+    # Any write renews the segment's sequence, so the results are read again
+    assert tree.insert(Point(20, 20, 20))
+    assert sorted(map(repr, tree.range_query(low, high))) == sorted(map(repr, [Point(10, 10, 10), Point(20, 20, 20)]))
+    assert tree.hits == hits + 2
+
+
+def test_move_and_collision(tree):
+    a, b = Point(100, 100, 100), Point(300, 300, 300)
+    tree.insert_many([a, b])
+    assert not tree.update_point(a, b)
+    assert tree.update_point(a, Point(110, 100, 100))
+    assert tree.search(a) is None
+    assert tree.detect_collision(Point(300, 310, 300))
+    assert not tree.detect_collision(Point(-300, -300, -300))
+
+
+def test_to_dict_holds_every_point(tree):
+    points = [Point(90 * i - 900, 900 - 90 * i, 50 * i - 500) for i in range(20)]
+    assert tree.insert_many(points) == [DAEMON_DONE] * len(points)
+    root = tree.to_dict()
+    # The C root spans -MAX_SIZE to MAX_SIZE, and its children tile it
+    assert root["size"] == 2000 and root["min"] == {"x": -1000, "y": -1000, "z": -1000}
+    assert root["max"] == {"x": 1000, "y": 1000, "z": 1000}
+    for child in root["children"]:
+        assert child["size"] == 1000
+        for axis in "xyz":
+            assert child["max"][axis] - child["min"][axis] == child["size"]
+            assert root["min"][axis] <= child["min"][axis] and child["max"][axis] <= root["max"][axis]
+            assert child["center"][axis] in (-500, 500)
+
+    def collect(node):
+        return node["points"] + [p for child in node["children"] for p in collect(child)]
+    assert len(collect(root)) == len(points)
+
+
+def test_other_process_sees_changes(tree, daemon):
+    tree.insert(Point(1, 2, 3))
+    script = (
+        "import sys\n"
+        "from backend.models.shared_octree import SharedOctree\n"
+        "from backend.models.point import Point\n"
+        "tree = SharedOctree(*sys.argv[1:4])\n"
+        "assert tree.search(Point(1, 2, 3)) is not None\n"
+        "assert tree.insert(Point(4, 5, 6))\n"
+    )
+    root = os.path.join(os.path.dirname(__file__), '..')
+    subprocess.run([sys.executable, "-c", script, daemon["socket"], daemon["shm"], daemon["library"]], cwd=root, check=True)
+    assert tree.search(Point(4, 5, 6)) is not None
+
+
+def test_stalled_worker_does_not_block_others(tree, daemon):
+    stalled = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    stalled.connect(daemon["socket"])
+    stalled.sendall(struct.pack("=II", 1, 4) + b"\0" * 5)   # Header and part of one record
+    assert tree.insert(Point(7, 8, 9))
+    assert tree.search_many([Point(7, 8, 9)]) == [True]
+    stalled.close()
+
+
+def test_bad_request_is_rejected(daemon):
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(daemon["socket"])
+    client.sendall(struct.pack("=II", 99, 1))
+    assert struct.unpack("=II", client.recv(8)) == (0xffffffff, 0)
+    assert client.recv(8) == b""
+    client.close()
+
+
+def test_segment_and_socket_are_private(tree, daemon):
+    tree.point_count()
+    assert stat.S_IMODE(os.stat("/dev/shm" + daemon["shm"]).st_mode) == 0o600
+    assert stat.S_IMODE(os.stat(daemon["socket"]).st_mode) & 0o077 == 0
+
+
+def test_workers_follow_a_restarted_daemon(build, tmp_path):
+    socket_path = str(tmp_path / "octree.sock")
+    shm_name = f"/octree_restart_{os.getpid()}"
+    process = start_daemon(build, tmp_path, socket_path, shm_name)
+    octree = SharedOctree(socket_path, shm_name, str(build / "libshmtree.so"))
+    try:
+        assert octree.insert(Point(1, 1, 1))
+        stop_daemon(process)
+        with pytest.raises(RuntimeError):
+            octree.search(Point(1, 1, 1))
+
+        # The new daemon recovers the tree from its journal and replaces the segment
+        process = start_daemon(build, tmp_path, socket_path, shm_name)
+        assert octree.search(Point(1, 1, 1)) is not None
+        assert octree.insert(Point(2, 2, 2))
+        assert octree.point_count() == 2
+
+        # A daemon that was killed leaves its segment behind; its successor closes it
+        process.kill()
+        process.wait()
+        process = start_daemon(build, tmp_path, socket_path, shm_name)
+        assert octree.search(Point(2, 2, 2)) is not None
+    finally:
+        octree.close()
+        stop_daemon(process)
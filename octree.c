@@ -4,9 +4,85 @@
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <stdatomic.h>
+#include <string.h>
 
 // Function implementations
 
+// Source of modification stamps, shared by all trees so a stamp is never reused.
+// Atomic because trees may be built on several threads at once.
+static atomic_ulong versionCounter = 0;
+
+// Hand out a fresh modification stamp
+unsigned long nextVersion(void) {
+    return atomic_fetch_add(&versionCounter, 1) + 1;
+}
+
+// Nodes normally come from malloc(). Compaction copies them into blocks so that
+// a tree lies in one piece of memory. Every node points to its block, so freeing
+// one needs no lookup. live counts the nodes of a block plus one while it is
+// open; whoever brings it to zero frees the block, so no lock is needed.
+struct NodeBlock {
+    OctreeNode *nodes;
+    int capacity;
+    int used;
+    atomic_int live;
+};
+
+static void dropReference(NodeBlock *block) {
+    if (atomic_fetch_sub(&block->live, 1) == 1) {
+        free(block->nodes);
+        free(block);
+    }
+}
+
+// Create an open block with room for capacity nodes
+NodeBlock *createNodeBlock(int capacity) {
+    NodeBlock *block = (NodeBlock *)malloc(sizeof(NodeBlock));
+    if (!block) {
+        perror("Failed to allocate memory for node block");
+        exit(EXIT_FAILURE);
+    }
+    block->nodes = (OctreeNode *)malloc((capacity > 0 ? capacity : 1) * sizeof(OctreeNode));
+    if (!block->nodes) {
+        perror("Failed to allocate memory for node block");
+        exit(EXIT_FAILURE);
+    }
+    block->capacity = capacity;
+    block->used = 0;
+    atomic_init(&block->live, 1);
+    return block;
+}
+
+// Copy node into the next free slot of block and release the original.
+// Returns the copy, or node itself if it already is in block or block is full.
+// Only one thread may place nodes in a block.
+OctreeNode *placeNode(NodeBlock *block, OctreeNode *node) {
+    if (block->used == block->capacity || node->block == block) return node;
+    OctreeNode *copy = &block->nodes[block->used++];
+    atomic_fetch_add(&block->live, 1);
+    memcpy(copy, node, sizeof(OctreeNode));
+    copy->block = block;
+    releaseNode(node);
+    return copy;
+}
+
+// No more nodes will be placed in block; frees it if none were kept
+void closeNodeBlock(NodeBlock *block) {
+    dropReference(block);
+}
+
+// Check if node was laid out by compaction
+bool isBlockNode(OctreeNode *node) {
+    return node->block != NULL;
+}
+
+// Free a single node, wherever it was allocated
+void releaseNode(OctreeNode *node) {
+    if (node->block != NULL) dropReference(node->block);
+    else free(node);
+}
+
 // Create a new octree node
 OctreeNode *createNode(Point center, float size, int depth) {
     OctreeNode *node = (OctreeNode *)malloc(sizeof(OctreeNode));
@@ -23,6 +99,8 @@ OctreeNode *createNode(Point center, float size, int depth) {
     node->size = size;
     node->depth = depth;
     node->isLeaf = 1;  // Initially, a node is considered a leaf
+    node->version = nextVersion();
+    node->block = NULL;
     for (int i = 0; i < 8; i++) node->children[i] = NULL;
     return node;
 }
@@ -71,6 +149,7 @@ OctreeNode *searchPoint(OctreeNode *node, Point *point) {
 
 // Insert a point into the octree
 bool insertPoint(OctreeNode *node, Point *point) {
+    node->version = nextVersion();
     if (node->isLeaf){
         if (node->ptCount < MAX_POINTS) {
             node->points[node->ptCount++] = *point;
@@ -102,13 +181,14 @@ bool insertPoint(OctreeNode *node, Point *point) {
 
 // Insert a point into the octree for collision detection we don't print the inserted point
 bool insertPoint_collision(OctreeNode *node, Point *point) {
+    node->version = nextVersion();
     if (node->isLeaf){
         if (node->ptCount < MAX_POINTS) {
             node->points[node->ptCount++] = *point;
             //printf("Inserted point (%.2f, %.2f, %.2f) at depth %d\n", point->x, point->y, point->z, node->depth);
             return true;
         } else if (node->depth == MAX_DEPTH) {
-            printf("Max depth reached.\n");
+            //printf("Max depth reached.\n");
             return false;
         } 
         else {
@@ -116,18 +196,18 @@ bool insertPoint_collision(OctreeNode *node, Point *point) {
             subdivideNode(node);
             for (int i = 0; i < node->ptCount; i++) {
                 int octant = getOctant(&node->center, &node->points[i]);
-                if (!insertPoint(node->children[octant], &node->points[i])) {
+                if (!insertPoint_collision(node->children[octant], &node->points[i])) {
                     printf("Failed to redistribute point during subdivision.\n");
                     return false;
                 }
             }
             node->ptCount = 0;
             int octant = getOctant(&node->center, point);
-            return insertPoint(node->children[octant], point);
+            return insertPoint_collision(node->children[octant], point);
         }
     } else {
         int octant = getOctant(&node->center, point);
-        return insertPoint(node->children[octant], point);
+        return insertPoint_collision(node->children[octant], point);
     }
 }
 
@@ -135,6 +215,7 @@ bool insertPoint_collision(OctreeNode *node, Point *point) {
 // Delete a point from the octree
 void deletePoint(OctreeNode *node, Point *point) {
     if (node == NULL) return;
+    node->version = nextVersion();
 
     if (node->isLeaf) {
         int found = -1;
@@ -182,7 +263,7 @@ void deletePoint(OctreeNode *node, Point *point) {
                             break;
                         }
                     }
-                    free(node->children[i]);
+                    releaseNode(node->children[i]);
                     node->children[i] = NULL;
                 }
             }
@@ -196,6 +277,7 @@ void deletePoint(OctreeNode *node, Point *point) {
 // Delete a point from the octree for collision detection, we don't print the deleted point
 void deletePoint_collision(OctreeNode *node, Point *point) {
     if (node == NULL) return;
+    node->version = nextVersion();
 
     if (node->isLeaf) {
         int found = -1;
@@ -243,7 +325,7 @@ void deletePoint_collision(OctreeNode *node, Point *point) {
                             break;
                         }
                     }
-                    free(node->children[i]);
+                    releaseNode(node->children[i]);
                     node->children[i] = NULL;
                 }
             }
@@ -277,6 +359,14 @@ void updatePointInTree(OctreeNode *root, Point *oldPoint, Point *newPoint) {
         }
         if (index != -1) {
             node->points[index] = *newPoint;
+            // Renew the stamps on the path down to the updated leaf
+            unsigned long version = nextVersion();
+            OctreeNode *n = root;
+            while (n != NULL) {
+                n->version = version;
+                if (n->isLeaf) break;
+                n = n->children[getOctant(&n->center, newPoint)];
+            }
             printf("Updated point in place within the same node to (%.2f, %.2f, %.2f)\n", newPoint->x, newPoint->y, newPoint->z);
         } else {
             printf("Point index not found in the node.\n");
@@ -433,6 +523,30 @@ void inlineRangeQuery(OctreeNode *node, Point *min, Point *max, int *count) {
     }
 }
 
+// Count points within a cube (inclusive) without printing them
+int countPointsInCube(OctreeNode *node, Point *min, Point *max) {
+    if (node == NULL) return 0;
+
+    // Check if the node is completely outside the cube
+    if (node->max.x < min->x || node->min.x > max->x ||
+        node->max.y < min->y || node->min.y > max->y ||
+        node->max.z < min->z || node->min.z > max->z) {
+        return 0;
+    }
+
+    int count = 0;
+    if (node->isLeaf) {
+        for (int i = 0; i < node->ptCount; i++) {
+            if (isPointInCube(&node->points[i], min, max)) count++;
+        }
+    } else {
+        for (int i = 0; i < 8; i++) {
+            count += countPointsInCube(node->children[i], min, max);
+        }
+    }
+    return count;
+}
+
 // Detect collision by checking nearby points
 bool detect_collision(OctreeNode *octree, Point moving_point, float box_size) {
     insertPoint_collision(octree, &moving_point);
@@ -462,7 +576,7 @@ void freeTree(OctreeNode *node) {
                 freeTree(node->children[i]);
             }
         }
-        free(node);
+        releaseNode(node);
     }
 }
 
@@ -491,12 +605,14 @@ static float distanceToCubeSquared(Point *p, Point *min, Point *max) {
 }
 
 // Nearest Neighbor Search Helper Function
-bool findNearestNeighborHelper(OctreeNode *node, Point target, Point *nearest, float *minDist) {
+// A node is skipped when its squared distance times scale exceeds the best found so far;
+// scale is 1 for an exact search and (1 + epsilon)^2 for an approximate one.
+bool findNearestNeighborHelper(OctreeNode *node, Point target, Point *nearest, float *minDist, float scale) {
     if (node == NULL) return false;
 
     // Calculate the squared distance from target to the node's cube
     float distToCube = distanceToCubeSquared(&target, &node->min, &node->max);
-    if (distToCube > (*minDist)) {
+    if (distToCube * scale > (*minDist)) {
         // Current node's region is farther than the best distance found
         return false;
     }
@@ -537,7 +653,7 @@ bool findNearestNeighborHelper(OctreeNode *node, Point target, Point *nearest, f
         for (int i = 0; i < 8; i++) {
             int idx = childOrder[i];
             if (node->children[idx] != NULL) {
-                bool childFound = findNearestNeighborHelper(node->children[idx], target, nearest, minDist);
+                bool childFound = findNearestNeighborHelper(node->children[idx], target, nearest, minDist, scale);
                 if (childFound) {
                     found = true;
                 }
@@ -551,10 +667,65 @@ bool findNearestNeighborHelper(OctreeNode *node, Point target, Point *nearest, f
 // Nearest Neighbor Search Function
 bool findNearestNeighbor(OctreeNode *node, Point target, Point *nearest, float *minDist) {
     *minDist = FLT_MAX;
-    bool found = findNearestNeighborHelper(node, target, nearest, minDist);
+    bool found = findNearestNeighborHelper(node, target, nearest, minDist, 1.0f);
+    if (found) {
+        *minDist = sqrtf(*minDist); // Return the actual distance
+    }
+    return found;
+}
+
+// Approximate nearest neighbor search limited to points closer than maxDist (FLT_MAX for no limit).
+// Any node farther than best / (1 + epsilon) is skipped, so the returned point is at most
+// (1 + epsilon) times farther than the true nearest neighbor; epsilon 0 gives the exact answer.
+bool findApproxNearestNeighbor(OctreeNode *node, Point target, float maxDist, float epsilon, Point *nearest, float *minDist) {
+    *minDist = maxDist < sqrtf(FLT_MAX) ? maxDist * maxDist : FLT_MAX;
+    float scale = (1.0f + epsilon) * (1.0f + epsilon);
+    bool found = findNearestNeighborHelper(node, target, nearest, minDist, scale);
     if (found) {
         *minDist = sqrtf(*minDist); // Return the actual distance
     }
     return found;
 }
 
+// Recursive fixed-radius query, points at a distance of at most radius from center
+void radiusQuery(OctreeNode *node, Point *center, float radius, int *count, FILE *fp) {
+    if (node == NULL) return;
+
+    // Check if the node's cube is completely outside the sphere
+    float radiusSquared = radius * radius;
+    if (distanceToCubeSquared(center, &node->min, &node->max) > radiusSquared) return;
+
+    if (node->isLeaf) {
+        for (int i = 0; i < node->ptCount; i++) {
+            if (squaredDistance(center, &node->points[i]) <= radiusSquared) {
+                fprintf(fp, "Point within sphere: (%.2f, %.2f, %.2f)\n", node->points[i].x, node->points[i].y, node->points[i].z);
+                (*count)++;
+            }
+        }
+    } else {
+        for (int i = 0; i < 8; i++) {
+            radiusQuery(node->children[i], center, radius, count, fp);
+        }
+    }
+}
+
+// Count points at a distance of at most radius from center without printing them
+int countPointsInRadius(OctreeNode *node, Point *center, float radius) {
+    if (node == NULL) return 0;
+
+    // Check if the node's cube is completely outside the sphere
+    float radiusSquared = radius * radius;
+    if (distanceToCubeSquared(center, &node->min, &node->max) > radiusSquared) return 0;
+
+    int count = 0;
+    if (node->isLeaf) {
+        for (int i = 0; i < node->ptCount; i++) {
+            if (squaredDistance(center, &node->points[i]) <= radiusSquared) count++;
+        }
+    } else {
+        for (int i = 0; i < 8; i++) {
+            count += countPointsInRadius(node->children[i], center, radius);
+        }
+    }
+    return count;
+}
@@ -5,6 +5,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Define constants
 #define MAX_SIZE 1000       // Maximum size of the octree
 #define MAX_DEPTH 5        // Maximum depth of the octree
@@ -17,6 +21,9 @@ typedef struct Point {
     float x, y, z;
 } Point;
 
+// Contiguous storage for nodes laid out by compaction (see compaction.h)
+typedef struct NodeBlock NodeBlock;
+
 // Octree node structure
 typedef struct OctreeNode {
     Point center;
@@ -26,12 +33,15 @@ typedef struct OctreeNode {
     float size;
     int depth;
     int isLeaf;
+    unsigned long version;   // Modification stamp, renewed on every insert/delete/update below this node
     Point points[MAX_POINTS];
     struct OctreeNode *children[8];
+    NodeBlock *block;        // Block the node lies in, NULL if it came from malloc()
 } OctreeNode;
 
 // Function prototypes
 OctreeNode *createNode(Point center, float size, int depth);
+unsigned long nextVersion(void);
 int getOctant(Point *center, Point *p);
 void subdivideNode(OctreeNode *node);
 OctreeNode *searchPoint(OctreeNode *node, Point *point);
@@ -41,10 +51,23 @@ void updatePointInTree(OctreeNode *root, Point *oldPoint, Point *newPoint);
 void readPoints(const char *filename, OctreeNode *root);
 void printTree(OctreeNode *node);
 void rangeQuery(OctreeNode *node, Point *min, Point *max, int *count, FILE *fp);
+int countPointsInCube(OctreeNode *node, Point *min, Point *max);
 bool detect_collision(OctreeNode *octree, Point moving_point, float box_size);
 void freeTree(OctreeNode *node);
+void releaseNode(OctreeNode *node);
+NodeBlock *createNodeBlock(int capacity);
+OctreeNode *placeNode(NodeBlock *block, OctreeNode *node);
+void closeNodeBlock(NodeBlock *block);
+bool isBlockNode(OctreeNode *node);
 void deletePoint_collision(OctreeNode *node, Point *point);
 bool insertPoint_collision(OctreeNode *node, Point *point);
 bool findNearestNeighbor(OctreeNode *node, Point target, Point *nearest, float *minDist);
+bool findApproxNearestNeighbor(OctreeNode *node, Point target, float maxDist, float epsilon, Point *nearest, float *minDist);
+void radiusQuery(OctreeNode *node, Point *center, float radius, int *count, FILE *fp);
+int countPointsInRadius(OctreeNode *node, Point *center, float radius);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif // OCTREE_H
\ No newline at end of file
@@ -0,0 +1,364 @@
+// octree.hpp
+#ifndef OCTREE_HPP
+#define OCTREE_HPP
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "octree.h"
+
+namespace octree {
+
+// Coordinates of a point in a templated tree
+template <typename Scalar>
+struct Vec3 {
+    Scalar x, y, z;
+    bool operator==(const Vec3 &o) const { return x == o.x && y == o.y && z == o.z; }
+    bool operator!=(const Vec3 &o) const { return !(*this == o); }
+};
+
+// Payload of a tree that only stores points
+struct NoPayload {};
+
+// Header-only octree with the layout parameters fixed at compile time.
+// Inserting, deleting and querying follow the C functions in octree.h
+// (insertPoint_collision, deletePoint_collision, countPointsInCube,
+// countPointsInRadius, findNearestNeighbor), so the same points give the same
+// results. Each depth is a separate instantiation and the callbacks are
+// template arguments, so the whole traversal can be inlined.
+// Integer coordinates use int64_t distances, and the root half size is rounded
+// up to a power of two of at least 2^MaxDepth so every cell halves exactly.
+// The tree owns its nodes and can be moved but not copied.
+template <typename Scalar = float, int LeafCapacity = MAX_POINTS, int MaxDepth = MAX_DEPTH, typename Payload = NoPayload>
+class Octree {
+    static_assert(std::is_floating_point<Scalar>::value || (std::is_integral<Scalar>::value && std::is_signed<Scalar>::value),
+                  "Scalar must be a floating point or signed integer type");
+    static_assert(LeafCapacity > 0, "LeafCapacity must be positive");
+    static_assert(MaxDepth >= 0 && MaxDepth < 24, "MaxDepth must be between 0 and 23");
+    static_assert(std::is_default_constructible<Payload>::value, "Payload must be default constructible");
+
+public:
+    using Coordinate = Scalar;
+    using Point = Vec3<Scalar>;
+    using Distance = typename std::conditional<std::is_integral<Scalar>::value, std::int64_t, Scalar>::type;
+
+    static constexpr int leafCapacity = LeafCapacity;
+    static constexpr int maxDepth = MaxDepth;
+
+    // Tree over the same cube as the C root created in study_operations.c
+    Octree() : Octree(Point{0, 0, 0}, static_cast<Scalar>(MAX_SIZE)) {}
+
+    Octree(const Point &center, Scalar halfSize) : root_(new Node()) {
+        root_->center = center;
+        root_->half = rootHalf(halfSize);
+    }
+
+    Octree(const Octree &) = delete;
+    Octree &operator=(const Octree &) = delete;
+    Octree(Octree &&) noexcept = default;
+    Octree &operator=(Octree &&) noexcept = default;
+
+    int size() const { return count_; }
+    const Point &center() const { return root_->center; }
+    Scalar halfSize() const { return root_->half; }
+
+    // Insert a point; false if its cell at MaxDepth is full. Like insertPoint_collision
+    // it does not look for duplicates.
+    bool insert(const Point &p, const Payload &payload = Payload()) {
+        bool inserted = insertAt<0>(*root_, p, payload);
+        if (inserted) count_++;
+        return inserted;
+    }
+
+    // Delete a point, merging children that fit into their parent on the way back up
+    bool erase(const Point &p) {
+        bool erased = eraseAt<0>(*root_, p);
+        if (erased) count_--;
+        return erased;
+    }
+
+    // Payload stored with a point, or nullptr if the point is not in the tree
+    const Payload *find(const Point &p) const {
+        const Node *node = root_.get();
+        while (!node->isLeaf()) node = &node->children[octant(node->center, p)];
+        for (int i = 0; i < node->count; i++) {
+            if (node->points[i] == p) return &node->payloads[i];
+        }
+        return nullptr;
+    }
+
+    Payload *find(const Point &p) {
+        return const_cast<Payload *>(static_cast<const Octree *>(this)->find(p));
+    }
+
+    bool contains(const Point &p) const { return find(p) != nullptr; }
+
+    // Call visit(point, payload) for every point of every leaf whose cube passes enter(min, max)
+    template <typename Enter, typename Visit>
+    void traverse(Enter &&enter, Visit &&visit) const {
+        walk<0>(*root_, enter, visit);
+    }
+
+    // Points with min <= p <= max on every axis, as countPointsInCube
+    template <typename Visit>
+    void forEachInBox(const Point &min, const Point &max, Visit &&visit) const {
+        traverse(
+            [&](const Point &lo, const Point &hi) {
+                return !(hi.x < min.x || lo.x > max.x || hi.y < min.y || lo.y > max.y || hi.z < min.z || lo.z > max.z);
+            },
+            [&](const Point &p, const Payload &payload) {
+                if (p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z) {
+                    visit(p, payload);
+                }
+            });
+    }
+
+    int countInBox(const Point &min, const Point &max) const {
+        int count = 0;
+        forEachInBox(min, max, [&](const Point &, const Payload &) { count++; });
+        return count;
+    }
+
+    // Points at a distance of at most radius from center, as countPointsInRadius
+    template <typename Visit>
+    void forEachInRadius(const Point &center, Scalar radius, Visit &&visit) const {
+        Distance radiusSquared = static_cast<Distance>(radius) * static_cast<Distance>(radius);
+        traverse(
+            [&](const Point &lo, const Point &hi) { return distanceToCubeSquared(center, lo, hi) <= radiusSquared; },
+            [&](const Point &p, const Payload &payload) {
+                if (squaredDistance(center, p) <= radiusSquared) visit(p, payload);
+            });
+    }
+
+    int countInRadius(const Point &center, Scalar radius) const {
+        int count = 0;
+        forEachInRadius(center, radius, [&](const Point &, const Payload &) { count++; });
+        return count;
+    }
+
+    // Nearest point other than target itself, with its squared distance, as findNearestNeighbor
+    bool nearest(const Point &target, Point &found, Distance &squaredDist) const {
+        squaredDist = std::numeric_limits<Distance>::max();
+        return nearestAt<0>(*root_, target, found, squaredDist);
+    }
+
+    // Build a tree over the same cube as a C tree, holding the same points
+    static Octree fromC(const OctreeNode *root) {
+        Octree tree(Point{static_cast<Scalar>(root->center.x), static_cast<Scalar>(root->center.y),
+                          static_cast<Scalar>(root->center.z)},
+                    static_cast<Scalar>(root->size));
+        copyFromC(tree, root);
+        return tree;
+    }
+
+    // Build a C tree over the same cube holding the same points; free it with freeTree()
+    OctreeNode *toC() const {
+        ::Point center = toCPoint(root_->center);
+        OctreeNode *root = createNode(center, static_cast<float>(root_->half), 0);
+        traverse([](const Point &, const Point &) { return true; },
+                 [&](const Point &p, const Payload &) {
+                     ::Point q = toCPoint(p);
+                     insertPoint_collision(root, &q);
+                 });
+        return root;
+    }
+
+    static ::Point toCPoint(const Point &p) {
+        return ::Point{static_cast<float>(p.x), static_cast<float>(p.y), static_cast<float>(p.z)};
+    }
+
+    static Point fromCPoint(const ::Point &p) {
+        return Point{static_cast<Scalar>(p.x), static_cast<Scalar>(p.y), static_cast<Scalar>(p.z)};
+    }
+
+private:
+    struct Node {
+        Point center{};
+        Scalar half{};
+        int count = 0;
+        Point points[LeafCapacity];
+        Payload payloads[LeafCapacity];
+        std::unique_ptr<Node[]> children;  // Eight children, or empty for a leaf
+
+        bool isLeaf() const { return !children; }
+        Point min() const { return Point{center.x - half, center.y - half, center.z - half}; }
+        Point max() const { return Point{center.x + half, center.y + half, center.z + half}; }
+    };
+
+    std::unique_ptr<Node> root_;
+    int count_ = 0;
+
+    static Scalar rootHalf(Scalar halfSize) {
+        if constexpr (std::is_floating_point<Scalar>::value) {
+            return halfSize;
+        } else {
+            Scalar half = static_cast<Scalar>(1) << MaxDepth;
+            while (half < halfSize) half *= 2;
+            return half;
+        }
+    }
+
+    static int octant(const Point &center, const Point &p) {
+        return (p.x >= center.x ? 4 : 0) | (p.y >= center.y ? 2 : 0) | (p.z >= center.z ? 1 : 0);
+    }
+
+    static Distance squaredDistance(const Point &a, const Point &b) {
+        Distance dx = static_cast<Distance>(a.x) - static_cast<Distance>(b.x);
+        Distance dy = static_cast<Distance>(a.y) - static_cast<Distance>(b.y);
+        Distance dz = static_cast<Distance>(a.z) - static_cast<Distance>(b.z);
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    static Distance axisGap(Scalar v, Scalar lo, Scalar hi) {
+        if (v < lo) return static_cast<Distance>(lo) - static_cast<Distance>(v);
+        if (v > hi) return static_cast<Distance>(v) - static_cast<Distance>(hi);
+        return 0;
+    }
+
+    static Distance distanceToCubeSquared(const Point &p, const Point &min, const Point &max) {
+        Distance dx = axisGap(p.x, min.x, max.x);
+        Distance dy = axisGap(p.y, min.y, max.y);
+        Distance dz = axisGap(p.z, min.z, max.z);
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    static void subdivide(Node &node) {
+        Scalar half = node.half / 2;
+        node.children.reset(new Node[8]);
+        for (int i = 0; i < 8; i++) {
+            Node &child = node.children[i];
+            child.center = Point{node.center.x + ((i & 4) ? half : -half),
+                                 node.center.y + ((i & 2) ? half : -half),
+                                 node.center.z + ((i & 1) ? half : -half)};
+            child.half = half;
+        }
+    }
+
+    template <int Depth>
+    static bool insertAt(Node &node, const Point &p, const Payload &payload) {
+        if constexpr (Depth < MaxDepth) {
+            if (!node.isLeaf()) return insertAt<Depth + 1>(node.children[octant(node.center, p)], p, payload);
+        }
+        if (node.count < LeafCapacity) {
+            node.points[node.count] = p;
+            node.payloads[node.count] = payload;
+            node.count++;
+            return true;
+        }
+        if constexpr (Depth < MaxDepth) {
+            // Subdivide and push the stored points into the empty children
+            subdivide(node);
+            for (int i = 0; i < node.count; i++) {
+                Node &child = node.children[octant(node.center, node.points[i])];
+                child.points[child.count] = node.points[i];
+                child.payloads[child.count] = std::move(node.payloads[i]);
+                child.count++;
+            }
+            node.count = 0;
+            return insertAt<Depth + 1>(node.children[octant(node.center, p)], p, payload);
+        } else {
+            return false;
+        }
+    }
+
+    template <int Depth>
+    static bool eraseAt(Node &node, const Point &p) {
+        if (node.isLeaf()) {
+            for (int i = 0; i < node.count; i++) {
+                if (node.points[i] == p) {
+                    for (int j = i; j < node.count - 1; j++) {
+                        node.points[j] = node.points[j + 1];
+                        node.payloads[j] = std::move(node.payloads[j + 1]);
+                    }
+                    node.count--;
+                    return true;
+                }
+            }
+            return false;
+        }
+        bool erased = false;
+        if constexpr (Depth < MaxDepth) erased = eraseAt<Depth + 1>(node.children[octant(node.center, p)], p);
+
+        // Merge the children when they are all leaves and their points fit
+        int total = 0;
+        for (int i = 0; i < 8; i++) {
+            if (!node.children[i].isLeaf()) return erased;
+            total += node.children[i].count;
+        }
+        if (total <= LeafCapacity) {
+            for (int i = 0; i < 8; i++) {
+                Node &child = node.children[i];
+                for (int j = 0; j < child.count; j++) {
+                    node.points[node.count] = child.points[j];
+                    node.payloads[node.count] = std::move(child.payloads[j]);
+                    node.count++;
+                }
+            }
+            node.children.reset();
+        }
+        return erased;
+    }
+
+    template <int Depth, typename Enter, typename Visit>
+    static void walk(const Node &node, Enter &enter, Visit &visit) {
+        if (!enter(node.min(), node.max())) return;
+        if (node.isLeaf()) {
+            for (int i = 0; i < node.count; i++) visit(node.points[i], node.payloads[i]);
+            return;
+        }
+        if constexpr (Depth < MaxDepth) {
+            for (int i = 0; i < 8; i++) walk<Depth + 1>(node.children[i], enter, visit);
+        }
+    }
+
+    template <int Depth>
+    static bool nearestAt(const Node &node, const Point &target, Point &found, Distance &best) {
+        if (distanceToCubeSquared(target, node.min(), node.max()) > best) return false;
+
+        bool improved = false;
+        if (node.isLeaf()) {
+            for (int i = 0; i < node.count; i++) {
+                Distance d = squaredDistance(target, node.points[i]);
+                if (d < best && d != 0) {  // Exclude the target point itself
+                    best = d;
+                    found = node.points[i];
+                    improved = true;
+                }
+            }
+            return improved;
+        }
+        if constexpr (Depth < MaxDepth) {
+            // Visit the children nearest first, in the same order as findNearestNeighborHelper
+            Distance gap[8];
+            int order[8];
+            for (int i = 0; i < 8; i++) {
+                gap[i] = distanceToCubeSquared(target, node.children[i].min(), node.children[i].max());
+                order[i] = i;
+            }
+            for (int i = 0; i < 7; i++) {
+                for (int j = i + 1; j < 8; j++) {
+                    if (gap[order[i]] > gap[order[j]]) std::swap(order[i], order[j]);
+                }
+            }
+            for (int i = 0; i < 8; i++) {
+                if (nearestAt<Depth + 1>(node.children[order[i]], target, found, best)) improved = true;
+            }
+        }
+        return improved;
+    }
+
+    static void copyFromC(Octree &tree, const OctreeNode *node) {
+        if (node == nullptr) return;
+        if (node->isLeaf) {
+            for (int i = 0; i < node->ptCount; i++) tree.insert(fromCPoint(node->points[i]));
+            return;
+        }
+        for (int i = 0; i < 8; i++) copyFromC(tree, node->children[i]);
+    }
+};
+
+}  // namespace octree
+
+#endif // OCTREE_HPP
@@ -0,0 +1,373 @@
+// octree_daemon.c
+#include "octree_daemon.h"
+#include "shm_tree.h"
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Largest request: header and two points per record
+#define DAEMON_REQUEST_SIZE (sizeof(DaemonHeader) + 2 * DAEMON_MAX_BATCH * sizeof(Point))
+
+// One process owns the tree: it applies every mutation, journals it and copies the
+// changed paths into the shared segment, from which the workers read without locking.
+typedef struct Daemon {
+    OctreeNode *root;
+    Journal *journal;
+    ShmTree *shm;
+    int points;
+    Point *found;         // Points of one range record
+    int foundCapacity;
+} Daemon;
+
+// A worker connection. Sockets are non-blocking: a request is collected in `in`
+// over as many reads as it takes and its reply is sent from `out` over as many
+// writes, so a slow worker never holds up the others.
+typedef struct Connection {
+    int fd;
+    unsigned char *in;
+    size_t inUsed;
+    unsigned char *out;
+    size_t outUsed;
+    size_t outSent;
+    size_t outCapacity;
+    bool closing;         // Close once the reply is sent
+} Connection;
+
+static volatile sig_atomic_t running = 1;
+
+static void stopDaemon(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Append to the reply of a connection
+static void put(Connection *c, const void *data, size_t size) {
+    if (c->outUsed + size > c->outCapacity) {
+        size_t capacity = c->outCapacity ? c->outCapacity : 4096;
+        while (capacity < c->outUsed + size) capacity *= 2;
+        c->out = (unsigned char *)realloc(c->out, capacity);
+        if (!c->out) {
+            perror("Failed to allocate memory for reply");
+            exit(EXIT_FAILURE);
+        }
+        c->outCapacity = capacity;
+    }
+    memcpy(c->out + c->outUsed, data, size);
+    c->outUsed += size;
+}
+
+// Room for every subdivision an insert can cause
+static bool shmHasRoom(Daemon *d) {
+    return shmFreeNodes(d->shm) >= 8 * MAX_DEPTH;
+}
+
+static DaemonStatus insertRecord(Daemon *d, Point *p) {
+    if (searchPoint(d->root, p) != NULL) return DAEMON_DUPLICATE;
+    if (!shmHasRoom(d)) return DAEMON_FULL;
+    if (!insertPoint_collision(d->root, p)) return DAEMON_FAILED;
+    journalAppend(d->journal, JOURNAL_INSERT, p, NULL);
+    d->points++;
+    return DAEMON_DONE;
+}
+
+static DaemonStatus deleteRecord(Daemon *d, Point *p) {
+    if (searchPoint(d->root, p) == NULL) return DAEMON_NOT_FOUND;
+    deletePoint_collision(d->root, p);
+    journalAppend(d->journal, JOURNAL_DELETE, p, NULL);
+    d->points--;
+    return DAEMON_DONE;
+}
+
+static DaemonStatus moveRecord(Daemon *d, Point *oldPoint, Point *newPoint) {
+    if (searchPoint(d->root, oldPoint) == NULL) return DAEMON_NOT_FOUND;
+    if (oldPoint->x == newPoint->x && oldPoint->y == newPoint->y && oldPoint->z == newPoint->z) return DAEMON_DONE;
+    if (searchPoint(d->root, newPoint) != NULL) return DAEMON_DUPLICATE;
+    if (!shmHasRoom(d)) return DAEMON_FULL;
+    deletePoint_collision(d->root, oldPoint);
+    if (!insertPoint_collision(d->root, newPoint)) {
+        insertPoint_collision(d->root, oldPoint);
+        return DAEMON_FAILED;
+    }
+    journalAppend(d->journal, JOURNAL_UPDATE, oldPoint, newPoint);
+    return DAEMON_DONE;
+}
+
+// Apply the mutations of one request. Workers see either none or all of them.
+static void applyMutations(Daemon *d, uint32_t op, Point *records, int count, unsigned char *status) {
+    beginShmWrite(d->shm);
+    for (int i = 0; i < count; i++) {
+        if (op == DAEMON_INSERT) status[i] = (unsigned char)insertRecord(d, &records[i]);
+        else if (op == DAEMON_DELETE) status[i] = (unsigned char)deleteRecord(d, &records[i]);
+        else status[i] = (unsigned char)moveRecord(d, &records[2 * i], &records[2 * i + 1]);
+        if (!syncShmTree(d->shm, d->root)) fprintf(stderr, "Shared segment is full, workers see an incomplete tree\n");
+    }
+    d->shm->points = d->points;
+    endShmWrite(d->shm);
+
+    journalCommit(d->journal);
+    if (journalCheckpointDue(d->journal)) journalCheckpoint(d->journal, d->root);
+}
+
+// Add the points of one range record to the reply, growing the buffer until they all fit
+static void replyRange(Daemon *d, Connection *c, Point *min, Point *max) {
+    int n = shmRangeQuery(d->shm, min, max, d->found, d->foundCapacity);
+    if (n > d->foundCapacity) {
+        free(d->found);
+        d->foundCapacity = n;
+        d->found = (Point *)malloc(n * sizeof(Point));
+        if (!d->found) {
+            perror("Failed to allocate memory for range results");
+            exit(EXIT_FAILURE);
+        }
+        n = shmRangeQuery(d->shm, min, max, d->found, d->foundCapacity);
+    }
+    uint32_t count = (uint32_t)n;
+    put(c, &count, sizeof(count));
+    put(c, d->found, n * sizeof(Point));
+}
+
+static size_t recordSize(uint32_t op) {
+    return (op == DAEMON_MOVE || op == DAEMON_RANGE ? 2 : 1) * sizeof(Point);
+}
+
+// Bytes the request in c->in needs in total, as far as known yet
+static size_t requestSize(Connection *c) {
+    if (c->inUsed < sizeof(DaemonHeader)) return sizeof(DaemonHeader);
+    DaemonHeader *header = (DaemonHeader *)c->in;
+    return sizeof(DaemonHeader) + header->count * recordSize(header->op);
+}
+
+static bool validHeader(DaemonHeader *header) {
+    return header->op >= DAEMON_INSERT && header->op <= DAEMON_NEAREST && header->count <= DAEMON_MAX_BATCH;
+}
+
+// Answer the complete request in c->in
+static void handleRequest(Daemon *d, Connection *c) {
+    DaemonHeader header = *(DaemonHeader *)c->in;
+    Point *records = (Point *)(c->in + sizeof(DaemonHeader));
+    int count = (int)header.count;
+    DaemonHeader reply = {0, header.count};
+    put(c, &reply, sizeof(reply));
+
+    static unsigned char status[DAEMON_MAX_BATCH];
+    switch (header.op) {
+        case DAEMON_INSERT:
+        case DAEMON_DELETE:
+        case DAEMON_MOVE:
+            applyMutations(d, header.op, records, count, status);
+            put(c, status, count);
+            break;
+        case DAEMON_SEARCH:
+            for (int i = 0; i < count; i++) {
+                status[i] = shmSearch(d->shm, &records[i]) == 1 ? DAEMON_DONE : DAEMON_NOT_FOUND;
+            }
+            put(c, status, count);
+            break;
+        case DAEMON_RANGE:
+            for (int i = 0; i < count; i++) replyRange(d, c, &records[2 * i], &records[2 * i + 1]);
+            break;
+        case DAEMON_NEAREST:
+            for (int i = 0; i < count; i++) {
+                DaemonNearest nearest;
+                memset(&nearest, 0, sizeof(nearest));
+                nearest.found = shmNearestNeighbor(d->shm, &records[i], false, &nearest.point, &nearest.distance) == 1;
+                put(c, &nearest, sizeof(nearest));
+            }
+            break;
+    }
+}
+
+// Send as much of the pending reply as the socket takes; false on error
+static bool flushConnection(Connection *c) {
+    while (c->outSent < c->outUsed) {
+        ssize_t n = write(c->fd, c->out + c->outSent, c->outUsed - c->outSent);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        c->outSent += (size_t)n;
+    }
+    c->outUsed = c->outSent = 0;
+    return true;
+}
+
+// Read what has arrived and answer every request completed by it; false closes the connection
+static bool serveConnection(Daemon *d, Connection *c) {
+    while (c->outUsed == 0 && !c->closing) {
+        size_t need = requestSize(c);
+        ssize_t n = read(c->fd, c->in + c->inUsed, need - c->inUsed);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        c->inUsed += (size_t)n;
+        if (c->inUsed == sizeof(DaemonHeader) && !validHeader((DaemonHeader *)c->in)) {
+            DaemonHeader reject = {DAEMON_BAD_REQUEST, 0};
+            put(c, &reject, sizeof(reject));
+            c->closing = true;
+        } else if (c->inUsed == requestSize(c)) {
+            handleRequest(d, c);
+            c->inUsed = 0;
+        }
+        if (!flushConnection(c)) return false;
+    }
+    return !(c->closing && c->outUsed == 0);
+}
+
+static void closeConnection(Connection *c) {
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+}
+
+// Insert the points of a text file with one "x y z" per line into an empty tree
+static void loadPoints(Daemon *d, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Failed to open points file");
+        exit(EXIT_FAILURE);
+    }
+    Point p;
+    while (fscanf(file, "%f %f %f", &p.x, &p.y, &p.z) == 3) {
+        if (searchPoint(d->root, &p) == NULL && insertPoint_collision(d->root, &p)) d->points++;
+    }
+    fclose(file);
+}
+
+// Listen on a socket only the daemon's user may connect to
+static int openSocket(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("Failed to create socket");
+        exit(EXIT_FAILURE);
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    mode_t mask = umask(0077);
+    int bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound == -1 || listen(fd, DAEMON_MAX_CLIENTS) == -1) {
+        perror("Failed to listen on socket");
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *socketPath = DAEMON_SOCKET;
+    const char *shmName = SHM_TREE_NAME;
+    const char *pointsFile = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:m:p:")) != -1) {
+        if (opt == 's') socketPath = optarg;
+        else if (opt == 'm') shmName = optarg;
+        else if (opt == 'p') pointsFile = optarg;
+        else {
+            fprintf(stderr, "Usage: %s [-s socket] [-m shared memory name] [-p initial points file]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+
+    // Recover the tree from the last checkpoint and the journal, or load the initial points
+    d.journal = openJournal(DAEMON_JOURNAL_FILE, DAEMON_CHECKPOINT_FILE, JOURNAL_SYNC_COMMIT, &d.root);
+    if (d.root == NULL) {
+        Point center = {0.0f, 0.0f, 0.0f};
+        d.root = createNode(center, MAX_SIZE, 0);
+        if (pointsFile) loadPoints(&d, pointsFile);
+        journalCheckpoint(d.journal, d.root);
+    } else {
+        Point min = {-MAX_SIZE, -MAX_SIZE, -MAX_SIZE};
+        Point max = {MAX_SIZE, MAX_SIZE, MAX_SIZE};
+        d.points = countPointsInCube(d.root, &min, &max);
+    }
+
+    d.shm = createShmTree(shmName, SHM_TREE_NODES);
+    beginShmWrite(d.shm);
+    if (!syncShmTree(d.shm, d.root)) fprintf(stderr, "Shared segment is full, workers see an incomplete tree\n");
+    d.shm->points = d.points;
+    endShmWrite(d.shm);
+
+    // Without SA_RESTART a signal interrupts poll() so the loop can stop
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopDaemon;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // fds[i + 1] belongs to clients[i]
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+    Connection clients[DAEMON_MAX_CLIENTS];
+    int nclients = 0;
+    fds[0].fd = openSocket(socketPath);
+    fds[0].events = POLLIN;
+    printf("Serving %d points on %s, shared memory %s\n", d.points, socketPath, shmName);
+    fflush(stdout);
+
+    while (running) {
+        for (int i = 0; i < nclients; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = clients[i].outUsed > 0 ? POLLOUT : POLLIN;
+            fds[i + 1].revents = 0;
+        }
+        if (poll(fds, nclients + 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        for (int i = nclients - 1; i >= 0; i--) {
+            short revents = fds[i + 1].revents;
+            if (revents == 0) continue;
+            bool open = !(revents & (POLLERR | POLLNVAL)) && flushConnection(&clients[i]) && serveConnection(&d, &clients[i]);
+            if (!open) {
+                closeConnection(&clients[i]);
+                clients[i] = clients[--nclients];
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(fds[0].fd, NULL, NULL);
+            if (fd != -1 && nclients < DAEMON_MAX_CLIENTS && fcntl(fd, F_SETFL, O_NONBLOCK) == 0) {
+                Connection *c = &clients[nclients++];
+                memset(c, 0, sizeof(*c));
+                c->fd = fd;
+                c->in = (unsigned char *)malloc(DAEMON_REQUEST_SIZE);
+                if (!c->in) {
+                    perror("Failed to allocate memory for requests");
+                    exit(EXIT_FAILURE);
+                }
+            } else if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+
+    for (int i = 0; i < nclients; i++) closeConnection(&clients[i]);
+    close(fds[0].fd);
+    unlink(socketPath);
+    journalCheckpoint(d.journal, d.root);
+    closeJournal(d.journal);
+    destroyShmTree(d.shm, shmName);
+    freeTree(d.root);
+    free(d.found);
+    return 0;
+}
@@ -0,0 +1,52 @@
+// octree_daemon.h
+#ifndef OCTREE_DAEMON_H
+#define OCTREE_DAEMON_H
+
+#include <stdint.h>
+#include "octree.h"
+
+// Define constants
+#define DAEMON_SOCKET "/tmp/octree.sock"                // Default Unix domain socket
+#define DAEMON_JOURNAL_FILE "OctreeDaemon.journal"      // Journal of the daemon's tree
+#define DAEMON_CHECKPOINT_FILE "OctreeDaemon.ckpt"      // Checkpoint of the daemon's tree
+#define DAEMON_MAX_BATCH 4096                           // Records in one request
+#define DAEMON_MAX_CLIENTS 64                           // Connected workers
+#define DAEMON_BAD_REQUEST 0xffffffffu                  // Reply op for a request that was not understood
+
+// Request kinds
+typedef enum DaemonOp {
+    DAEMON_INSERT = 1,    // One Point per record
+    DAEMON_DELETE = 2,    // One Point per record
+    DAEMON_MOVE = 3,      // Old and new Point per record
+    DAEMON_SEARCH = 4,    // One Point per record
+    DAEMON_RANGE = 5,     // Min and max corner per record
+    DAEMON_NEAREST = 6    // One Point per record
+} DaemonOp;
+
+// Result of one insert, delete, move or search record
+typedef enum DaemonStatus {
+    DAEMON_DONE = 0,      // Done, or found for a search
+    DAEMON_DUPLICATE = 1, // The point (the new point of a move) is already in the tree
+    DAEMON_NOT_FOUND = 2, // The point (the old point of a move) is not in the tree
+    DAEMON_FAILED = 3,    // Its cell at MAX_DEPTH is full; a move keeps the old point
+    DAEMON_FULL = 4       // The shared segment has no room left for subdivisions
+} DaemonStatus;
+
+// Every request and reply starts with this header, followed by count records in host
+// byte order. A reply repeats the count with op 0 (DAEMON_BAD_REQUEST and count 0 if
+// the request was rejected, after which the connection is closed) and carries
+// - one status byte per record for insert, delete, move and search,
+// - one DaemonNearest per record for nearest,
+// - per record a uint32_t number of points followed by those points for range.
+typedef struct DaemonHeader {
+    uint32_t op;
+    uint32_t count;
+} DaemonHeader;
+
+typedef struct DaemonNearest {
+    uint32_t found;
+    Point point;
+    float distance;
+} DaemonNearest;
+
+#endif // OCTREE_DAEMON_H
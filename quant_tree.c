@@ -0,0 +1,304 @@
+// quant_tree.c
+#include "quant_tree.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+// Create an empty compressed tree over the root cube
+static QuantOctree *createQuantTree(Point center, float size) {
+    QuantOctree *qt = (QuantOctree *)calloc(1, sizeof(QuantOctree));
+    if (!qt) {
+        perror("Failed to allocate memory for compressed octree");
+        exit(EXIT_FAILURE);
+    }
+    qt->center = center;
+    qt->size = size;
+    return qt;
+}
+
+// Reserve n consecutive nodes and return the index of the first
+static uint32_t reserveNodes(QuantOctree *qt, int n) {
+    if (qt->nodeCount + n > qt->nodeCapacity) {
+        int newCapacity = qt->nodeCapacity ? qt->nodeCapacity * 2 : 64;
+        while (newCapacity < qt->nodeCount + n) newCapacity *= 2;
+        QuantNode *nodes = (QuantNode *)realloc(qt->nodes, newCapacity * sizeof(QuantNode));
+        if (!nodes) {
+            perror("Failed to grow compressed octree nodes");
+            exit(EXIT_FAILURE);
+        }
+        qt->nodes = nodes;
+        qt->nodeCapacity = newCapacity;
+    }
+    uint32_t first = qt->nodeCount;
+    qt->nodeCount += n;
+    return first;
+}
+
+// Center of child octant i, as in subdivideNode()
+static Point childCenter(Point center, float size, int i) {
+    float halfSize = size / 2.0;
+    Point c = {
+        center.x + ((i & 4) ? halfSize : -halfSize),
+        center.y + ((i & 2) ? halfSize : -halfSize),
+        center.z + ((i & 1) ? halfSize : -halfSize)
+    };
+    return c;
+}
+
+// Quantize one coordinate relative to the low edge of its cell
+static QuantCoord quantize(float v, float cellMin, float step) {
+    double q = floor((v - cellMin) / (double)step + 0.5);
+    if (q < 0) q = 0;
+    if (q > QUANT_MAX) q = QUANT_MAX;
+    return (QuantCoord)q;
+}
+
+static float dequantize(QuantCoord q, float cellMin, float step) {
+    return (float)(cellMin + (double)q * step);
+}
+
+// Append the points of a leaf cell, quantized within its bounds
+static void appendLeafPoints(QuantOctree *qt, QuantNode *node, Point *points, int count, Point center, float size) {
+    if (qt->ptCount + count > qt->ptCapacity) {
+        int newCapacity = qt->ptCapacity ? qt->ptCapacity * 2 : 64;
+        while (newCapacity < qt->ptCount + count) newCapacity *= 2;
+        QuantPoint *grown = (QuantPoint *)realloc(qt->points, newCapacity * sizeof(QuantPoint));
+        if (!grown) {
+            perror("Failed to grow compressed octree points");
+            exit(EXIT_FAILURE);
+        }
+        qt->points = grown;
+        qt->ptCapacity = newCapacity;
+    }
+    float step = 2.0f * size / QUANT_MAX;
+    node->first = qt->ptCount;
+    node->ptCount = (uint8_t)count;
+    node->isLeaf = 1;
+    for (int i = 0; i < count; i++) {
+        QuantPoint *q = &qt->points[qt->ptCount++];
+        q->x = quantize(points[i].x, center.x - size, step);
+        q->y = quantize(points[i].y, center.y - size, step);
+        q->z = quantize(points[i].z, center.z - size, step);
+    }
+}
+
+// Fill node idx from an array of points, splitting the same way insertPoint() does.
+// scratch must hold count points; the order of points within an octant is kept.
+static void buildNode(QuantOctree *qt, uint32_t idx, Point *points, Point *scratch, int count,
+                      Point center, float size, int depth) {
+    if (count <= MAX_POINTS || depth == MAX_DEPTH) {
+        // A full leaf at MAX_DEPTH keeps the first MAX_POINTS, like insertPoint()
+        appendLeafPoints(qt, &qt->nodes[idx], points, count < MAX_POINTS ? count : MAX_POINTS, center, size);
+        return;
+    }
+
+    int sizes[8] = {0};
+    int offsets[8];
+    for (int i = 0; i < count; i++) sizes[getOctant(&center, &points[i])]++;
+    offsets[0] = 0;
+    for (int o = 1; o < 8; o++) offsets[o] = offsets[o - 1] + sizes[o - 1];
+    int fill[8];
+    memcpy(fill, offsets, sizeof(fill));
+    for (int i = 0; i < count; i++) scratch[fill[getOctant(&center, &points[i])]++] = points[i];
+    memcpy(points, scratch, count * sizeof(Point));
+
+    uint32_t first = reserveNodes(qt, 8);  // May move qt->nodes, so index it afterwards
+    qt->nodes[idx].first = first;
+    qt->nodes[idx].ptCount = 0;
+    qt->nodes[idx].isLeaf = 0;
+    for (int o = 0; o < 8; o++) {
+        buildNode(qt, first + o, points + offsets[o], scratch, sizes[o], childCenter(center, size, o), size / 2.0, depth + 1);
+    }
+}
+
+// Build a compressed tree directly from points, without the pointer-based tree.
+// The result has the shape that inserting the points in order would give.
+QuantOctree *buildQuantTree(Point *points, int count) {
+    Point center = {0.0f, 0.0f, 0.0f};
+    QuantOctree *qt = createQuantTree(center, MAX_SIZE);
+    Point *work = (Point *)malloc((count > 0 ? count : 1) * 2 * sizeof(Point));
+    if (!work) {
+        perror("Failed to allocate memory for compressed octree build");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(work, points, count * sizeof(Point));
+    uint32_t root = reserveNodes(qt, 1);
+    buildNode(qt, root, work, work + count, count, center, MAX_SIZE, 0);
+    free(work);
+    return qt;
+}
+
+// Copy an existing tree into node idx
+static void compressNode(QuantOctree *qt, uint32_t idx, OctreeNode *node) {
+    if (node->isLeaf) {
+        appendLeafPoints(qt, &qt->nodes[idx], node->points, node->ptCount, node->center, node->size);
+        return;
+    }
+    uint32_t first = reserveNodes(qt, 8);
+    qt->nodes[idx].first = first;
+    qt->nodes[idx].ptCount = 0;
+    qt->nodes[idx].isLeaf = 0;
+    for (int o = 0; o < 8; o++) {
+        compressNode(qt, first + o, node->children[o]);
+    }
+}
+
+// Compress an existing octree
+QuantOctree *compressTree(OctreeNode *root) {
+    QuantOctree *qt = createQuantTree(root->center, root->size);
+    uint32_t idx = reserveNodes(qt, 1);
+    compressNode(qt, idx, root);
+    return qt;
+}
+
+// Range query, comparing in the quantized domain and dequantizing only the matches
+static void quantRangeNode(QuantOctree *qt, uint32_t idx, Point center, float size,
+                           Point *min, Point *max, int *count, FILE *fp) {
+    // Check if the node is completely outside the cube
+    if (center.x + size < min->x || center.x - size > max->x ||
+        center.y + size < min->y || center.y - size > max->y ||
+        center.z + size < min->z || center.z - size > max->z) {
+        return;
+    }
+
+    QuantNode *node = &qt->nodes[idx];
+    if (!node->isLeaf) {
+        for (int o = 0; o < 8; o++) {
+            quantRangeNode(qt, node->first + o, childCenter(center, size, o), size / 2.0, min, max, count, fp);
+        }
+        return;
+    }
+    if (node->ptCount == 0) return;
+
+    float step = 2.0f * size / QUANT_MAX;
+    float cellMin[3] = { center.x - size, center.y - size, center.z - size };
+
+    // A cell inside the cube matches all its points without looking at them, unless they are printed
+    if (!fp && center.x - size >= min->x && center.x + size <= max->x &&
+        center.y - size >= min->y && center.y + size <= max->y &&
+        center.z - size >= min->z && center.z + size <= max->z) {
+        *count += node->ptCount;
+        return;
+    }
+
+    // Smallest and largest quantized offsets whose dequantized value lies in the cube
+    float lo[3] = { min->x, min->y, min->z };
+    float hi[3] = { max->x, max->y, max->z };
+    int64_t qlo[3], qhi[3];
+    for (int a = 0; a < 3; a++) {
+        double l = ceil((lo[a] - cellMin[a]) / (double)step);
+        double h = floor((hi[a] - cellMin[a]) / (double)step);
+        qlo[a] = l < 0 ? 0 : (l > QUANT_MAX ? (int64_t)QUANT_MAX + 1 : (int64_t)l);
+        qhi[a] = h < 0 ? -1 : (h > QUANT_MAX ? (int64_t)QUANT_MAX : (int64_t)h);
+        if (qlo[a] > qhi[a]) return;
+    }
+
+    for (int i = 0; i < node->ptCount; i++) {
+        QuantPoint *q = &qt->points[node->first + i];
+        if (q->x < qlo[0] || q->x > qhi[0] ||
+            q->y < qlo[1] || q->y > qhi[1] ||
+            q->z < qlo[2] || q->z > qhi[2]) {
+            continue;
+        }
+        if (fp) {
+            fprintf(fp, "Point within cube: (%.2f, %.2f, %.2f)\n",
+                    dequantize(q->x, cellMin[0], step), dequantize(q->y, cellMin[1], step), dequantize(q->z, cellMin[2], step));
+        }
+        (*count)++;
+    }
+}
+
+// Range query over the compressed tree, same output as rangeQuery(); fp may be NULL to only count
+void quantRangeQuery(QuantOctree *qt, Point *min, Point *max, int *count, FILE *fp) {
+    if (qt->nodeCount == 0) return;
+    quantRangeNode(qt, 0, qt->center, qt->size, min, max, count, fp);
+}
+
+// Squared distance from a point to a node cube given by center and size
+static float quantDistanceToCubeSquared(Point *p, Point center, float size) {
+    float d[3] = { fabsf(p->x - center.x) - size, fabsf(p->y - center.y) - size, fabsf(p->z - center.z) - size };
+    float sum = 0.0f;
+    for (int a = 0; a < 3; a++) {
+        if (d[a] > 0.0f) sum += d[a] * d[a];
+    }
+    return sum;
+}
+
+// Nearest neighbor helper, visiting children nearest first
+static bool quantNearestNode(QuantOctree *qt, uint32_t idx, Point center, float size,
+                             Point *target, Point *nearest, float *minDist) {
+    if (quantDistanceToCubeSquared(target, center, size) > *minDist) return false;
+
+    QuantNode *node = &qt->nodes[idx];
+    bool found = false;
+    if (node->isLeaf) {
+        float step = 2.0f * size / QUANT_MAX;
+        for (int i = 0; i < node->ptCount; i++) {
+            QuantPoint *q = &qt->points[node->first + i];
+            Point p = {
+                dequantize(q->x, center.x - size, step),
+                dequantize(q->y, center.y - size, step),
+                dequantize(q->z, center.z - size, step)
+            };
+            float dx = p.x - target->x, dy = p.y - target->y, dz = p.z - target->z;
+            float dist = dx*dx + dy*dy + dz*dz;
+            if (dist < *minDist && dist != 0.0f) { // Exclude the target point itself
+                *minDist = dist;
+                *nearest = p;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Sort children by distance to target
+    int order[8];
+    float dist[8];
+    for (int o = 0; o < 8; o++) {
+        dist[o] = quantDistanceToCubeSquared(target, childCenter(center, size, o), size / 2.0);
+        int j = o;
+        while (j > 0 && dist[order[j - 1]] > dist[o]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = o;
+    }
+    for (int i = 0; i < 8; i++) {
+        int o = order[i];
+        if (quantNearestNode(qt, node->first + o, childCenter(center, size, o), size / 2.0, target, nearest, minDist)) {
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Nearest neighbor search over the compressed tree, same contract as findNearestNeighbor()
+bool quantFindNearestNeighbor(QuantOctree *qt, Point target, Point *nearest, float *minDist) {
+    *minDist = FLT_MAX;
+    if (qt->nodeCount == 0) return false;
+    bool found = quantNearestNode(qt, 0, qt->center, qt->size, &target, nearest, minDist);
+    if (found) {
+        *minDist = sqrtf(*minDist); // Return the actual distance
+    }
+    return found;
+}
+
+// Largest per-axis error of a coordinate stored in a leaf at the given depth
+float quantTolerance(QuantOctree *qt, int depth) {
+    return qt->size / (float)(1 << depth) / QUANT_MAX;
+}
+
+// Bytes used by nodes and points
+size_t quantMemoryBytes(QuantOctree *qt) {
+    return sizeof(QuantOctree) + (size_t)qt->nodeCount * sizeof(QuantNode) + (size_t)qt->ptCount * sizeof(QuantPoint);
+}
+
+// Free all memory allocated for the compressed tree
+void freeQuantTree(QuantOctree *qt) {
+    if (qt) {
+        free(qt->nodes);
+        free(qt->points);
+        free(qt);
+    }
+}
@@ -0,0 +1,68 @@
+// quant_tree.h
+#ifndef QUANT_TREE_H
+#define QUANT_TREE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "octree.h"
+
+// Define constants
+#define QUANT_BITS 16                               // Bits per stored coordinate (1 to 32)
+#define QUANT_MAX ((uint32_t)((1ull << QUANT_BITS) - 1))  // Largest quantized offset
+
+// Storage type of a quantized coordinate
+#if QUANT_BITS <= 8
+typedef uint8_t QuantCoord;
+#elif QUANT_BITS <= 16
+typedef uint16_t QuantCoord;
+#else
+typedef uint32_t QuantCoord;
+#endif
+
+// Point stored as offsets within its leaf cell
+typedef struct QuantPoint {
+    QuantCoord x, y, z;
+} QuantPoint;
+
+// Compact node without stored bounds; they are derived from the path during traversal.
+// An internal node's 8 children are stored next to each other starting at 'first',
+// a leaf's points are stored next to each other starting at 'first'.
+typedef struct QuantNode {
+    uint32_t first;
+    uint8_t ptCount;
+    uint8_t isLeaf;
+} QuantNode;
+
+// Read-only compressed snapshot of an octree with the same shape as the OctreeNode
+// tree. It is built once and cannot be changed: there is no insert, delete or
+// update, so after the OctreeNode tree changes a new snapshot has to be built.
+// It takes less memory, but range queries are slower than on the OctreeNode tree
+// because every node's bounds are recomputed on the way down; benchmark.c prints
+// both ratios for the data and machine at hand.
+// Tolerance: a coordinate is stored as one of QUANT_MAX + 1 evenly spaced
+// values across its leaf cell, so it is returned with an absolute error of at
+// most (leaf edge) / (2 * QUANT_MAX) per axis. With QUANT_BITS 16 and
+// MAX_SIZE 1000 this is about 0.0005 at MAX_DEPTH and 0.016 when the root is
+// the only leaf. Points outside the root cube are clamped onto its faces.
+typedef struct QuantOctree {
+    Point center;
+    float size;
+    QuantNode *nodes;
+    int nodeCount;
+    int nodeCapacity;
+    QuantPoint *points;
+    int ptCount;
+    int ptCapacity;
+} QuantOctree;
+
+// Function prototypes
+QuantOctree *buildQuantTree(Point *points, int count);
+QuantOctree *compressTree(OctreeNode *root);
+void quantRangeQuery(QuantOctree *qt, Point *min, Point *max, int *count, FILE *fp);
+bool quantFindNearestNeighbor(QuantOctree *qt, Point target, Point *nearest, float *minDist);
+float quantTolerance(QuantOctree *qt, int depth);
+size_t quantMemoryBytes(QuantOctree *qt);
+void freeQuantTree(QuantOctree *qt);
+
+#endif // QUANT_TREE_H
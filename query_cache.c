@@ -0,0 +1,207 @@
+// query_cache.c
+#include "query_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+// Create an empty query cache
+QueryCache *createQueryCache(void) {
+    QueryCache *cache = (QueryCache *)calloc(1, sizeof(QueryCache));
+    if (!cache) {
+        perror("Failed to allocate memory for query cache");
+        exit(EXIT_FAILURE);
+    }
+    return cache;
+}
+
+// Hash the query parameters to an entry slot
+static CacheEntry *slotFor(QueryCache *cache, QueryType type, OctreeNode *root, Point *a, Point *b) {
+    unsigned int words[6];
+    memcpy(&words[0], a, sizeof(Point));
+    memcpy(&words[3], b, sizeof(Point));
+    unsigned int h = 2166136261u ^ (unsigned int)type ^ (unsigned int)(size_t)root;
+    for (int i = 0; i < 6; i++) {
+        h = (h ^ words[i]) * 16777619u;
+    }
+    return &cache->entries[h & (CACHE_ENTRIES - 1)];
+}
+
+static bool samePoint(Point *p, Point *q) {
+    return p->x == q->x && p->y == q->y && p->z == q->z;
+}
+
+// Octant of node whose routing region holds the whole box, or -1 if the box spans several
+static int containingOctant(OctreeNode *node, Point *min, Point *max) {
+    int octant = 0;
+    if (min->x >= node->center.x) octant |= 4; else if (max->x >= node->center.x) return -1;
+    if (min->y >= node->center.y) octant |= 2; else if (max->y >= node->center.y) return -1;
+    if (min->z >= node->center.z) octant |= 1; else if (max->z >= node->center.z) return -1;
+    return octant;
+}
+
+// Check if the box reaches into the routing region of a child octant
+static bool octantIntersects(OctreeNode *node, int octant, Point *min, Point *max) {
+    if ((octant & 4) ? max->x < node->center.x : min->x >= node->center.x) return false;
+    if ((octant & 2) ? max->y < node->center.y : min->y >= node->center.y) return false;
+    if ((octant & 1) ? max->z < node->center.z : min->z >= node->center.z) return false;
+    return true;
+}
+
+// Record the covering path and subtree stamps a query over the box depends on
+static void recordStamps(CacheEntry *e, OctreeNode *root, Point *min, Point *max) {
+    OctreeNode *node = root;
+    e->pathLength = 0;
+    while (!node->isLeaf && e->pathLength <= MAX_DEPTH) {
+        int octant = containingOctant(node, min, max);
+        if (octant == -1) break;
+        e->path[e->pathLength++] = (unsigned char)octant;
+        node = node->children[octant];
+    }
+
+    e->coverIsLeaf = node->isLeaf;
+    e->stampCount = 0;
+    if (node->isLeaf) {
+        e->stamps[e->stampCount++] = node->version;
+    } else {
+        for (int i = 0; i < 8; i++) {
+            if (octantIntersects(node, i, min, max)) {
+                e->stampOctant[e->stampCount] = (unsigned char)i;
+                e->stamps[e->stampCount++] = node->children[i]->version;
+            }
+        }
+    }
+}
+
+// Follow the recorded path and compare the stamps, without re-running the query
+static bool stampsValid(CacheEntry *e, OctreeNode *root) {
+    OctreeNode *node = root;
+    for (int i = 0; i < e->pathLength; i++) {
+        if (node->isLeaf) return false;
+        node = node->children[e->path[i]];
+    }
+    if (node->isLeaf != e->coverIsLeaf) return false;
+    if (node->isLeaf) return node->version == e->stamps[0];
+    for (int i = 0; i < e->stampCount; i++) {
+        if (node->children[e->stampOctant[i]]->version != e->stamps[i]) return false;
+    }
+    return true;
+}
+
+// Look up a valid entry for the query, or NULL
+static CacheEntry *lookup(QueryCache *cache, QueryType type, OctreeNode *root, Point *a, Point *b) {
+    CacheEntry *e = slotFor(cache, type, root, a, b);
+    if (e->valid && e->type == type && e->root == root &&
+        samePoint(&e->a, a) && samePoint(&e->b, b) && stampsValid(e, root)) {
+        cache->hits++;
+        return e;
+    }
+    cache->misses++;
+    return NULL;
+}
+
+// Append a point to an entry's result, growing it when full
+static void appendResult(CacheEntry *e, Point *p) {
+    if (e->count == e->capacity) {
+        int newCapacity = e->capacity ? e->capacity * 2 : 16;
+        Point *points = (Point *)realloc(e->points, newCapacity * sizeof(Point));
+        if (!points) {
+            perror("Failed to grow cached query result");
+            exit(EXIT_FAILURE);
+        }
+        e->points = points;
+        e->capacity = newCapacity;
+    }
+    e->points[e->count++] = *p;
+}
+
+// Range query collecting the points into an entry, same pruning as rangeQuery()
+static void collectRange(OctreeNode *node, Point *min, Point *max, CacheEntry *e) {
+    if (node == NULL) return;
+
+    if (node->max.x < min->x || node->min.x > max->x ||
+        node->max.y < min->y || node->min.y > max->y ||
+        node->max.z < min->z || node->min.z > max->z) {
+        return;
+    }
+
+    if (node->isLeaf) {
+        for (int i = 0; i < node->ptCount; i++) {
+            Point *p = &node->points[i];
+            if (p->x >= min->x && p->x <= max->x &&
+                p->y >= min->y && p->y <= max->y &&
+                p->z >= min->z && p->z <= max->z) {
+                appendResult(e, p);
+            }
+        }
+    } else {
+        for (int i = 0; i < 8; i++) {
+            collectRange(node->children[i], min, max, e);
+        }
+    }
+}
+
+// Range query served from the cache when no touched subtree has changed.
+// Returns the number of points; *results stays valid until the next call on this cache.
+int cachedRangeQuery(QueryCache *cache, OctreeNode *root, Point *min, Point *max, Point **results) {
+    CacheEntry *e = lookup(cache, QUERY_RANGE, root, min, max);
+    if (e == NULL) {
+        e = slotFor(cache, QUERY_RANGE, root, min, max);
+        e->valid = true;
+        e->type = QUERY_RANGE;
+        e->root = root;
+        e->a = *min;
+        e->b = *max;
+        e->count = 0;
+        collectRange(root, min, max, e);
+        recordStamps(e, root, min, max);
+    }
+    *results = e->points;
+    return e->count;
+}
+
+// Nearest neighbor search served from the cache when no touched subtree has changed.
+// The result only depends on the points within minDist of the target, so the entry
+// stamps the box of that radius (the whole tree when nothing was found).
+bool cachedNearestNeighbor(QueryCache *cache, OctreeNode *root, Point target, Point *nearest, float *minDist) {
+    Point unused = {0.0f, 0.0f, 0.0f};
+    CacheEntry *e = lookup(cache, QUERY_NEAREST, root, &target, &unused);
+    if (e == NULL) {
+        e = slotFor(cache, QUERY_NEAREST, root, &target, &unused);
+        e->valid = true;
+        e->type = QUERY_NEAREST;
+        e->root = root;
+        e->a = target;
+        e->b = unused;
+        e->count = 0;
+        e->found = findNearestNeighbor(root, target, &e->nearest, &e->minDist);
+
+        // Widen slightly so the rounding of sqrtf() cannot leave the neighbor outside the box
+        float reach = e->found ? e->minDist * 1.0001f + 0.001f : FLT_MAX;
+        Point min = { target.x - reach, target.y - reach, target.z - reach };
+        Point max = { target.x + reach, target.y + reach, target.z + reach };
+        recordStamps(e, root, &min, &max);
+    }
+    if (e->found) {
+        *nearest = e->nearest;
+        *minDist = e->minDist;
+    }
+    return e->found;
+}
+
+// Drop every cached result
+void clearQueryCache(QueryCache *cache) {
+    for (int i = 0; i < CACHE_ENTRIES; i++) {
+        cache->entries[i].valid = false;
+    }
+}
+
+// Free all memory allocated for the cache
+void freeQueryCache(QueryCache *cache) {
+    if (cache) {
+        for (int i = 0; i < CACHE_ENTRIES; i++) {
+            free(cache->entries[i].points);
+        }
+        free(cache);
+    }
+}
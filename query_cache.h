@@ -0,0 +1,56 @@
+// query_cache.h
+#ifndef QUERY_CACHE_H
+#define QUERY_CACHE_H
+
+#include <stdbool.h>
+#include "octree.h"
+
+// Define constants
+#define CACHE_ENTRIES 64     // Number of cached query results (direct mapped, power of two)
+#define CACHE_MAX_STAMPS 8   // Subtree stamps recorded per entry
+
+// Kind of query an entry holds
+typedef enum QueryType {
+    QUERY_RANGE,
+    QUERY_NEAREST
+} QueryType;
+
+// A cached query result together with the subtree stamps it depends on.
+// The entry remembers the octants leading from the root to the smallest node
+// containing the query box, and the versions of that node's children that the
+// box reaches (or of the node itself when it is a leaf). The result is still
+// valid as long as the path exists and none of those versions have changed.
+typedef struct CacheEntry {
+    bool valid;
+    QueryType type;
+    OctreeNode *root;
+    Point a, b;                               // Range: min and max corners, nearest: target in a
+    int pathLength;
+    unsigned char path[MAX_DEPTH + 1];        // Octants from the root to the covering node
+    bool coverIsLeaf;
+    int stampCount;
+    unsigned char stampOctant[CACHE_MAX_STAMPS];
+    unsigned long stamps[CACHE_MAX_STAMPS];
+    Point *points;                            // Range query result
+    int count;
+    int capacity;
+    bool found;                               // Nearest neighbor result
+    Point nearest;
+    float minDist;
+} CacheEntry;
+
+// Query result cache keyed by query parameters
+typedef struct QueryCache {
+    CacheEntry entries[CACHE_ENTRIES];
+    int hits;
+    int misses;
+} QueryCache;
+
+// Function prototypes
+QueryCache *createQueryCache(void);
+int cachedRangeQuery(QueryCache *cache, OctreeNode *root, Point *min, Point *max, Point **results);
+bool cachedNearestNeighbor(QueryCache *cache, OctreeNode *root, Point target, Point *nearest, float *minDist);
+void clearQueryCache(QueryCache *cache);
+void freeQueryCache(QueryCache *cache);
+
+#endif // QUERY_CACHE_H
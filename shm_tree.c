@@ -0,0 +1,420 @@
+// shm_tree.c
+#include "shm_tree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t segmentSize(int capacity) {
+    return sizeof(ShmTree) + (size_t)capacity * sizeof(ShmNode);
+}
+
+// Mark a segment left by an earlier daemon closed, so readers still mapping it attach again
+static void closeOldShmTree(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmTree)) {
+        ShmTree *old = (ShmTree *)mmap(NULL, sizeof(ShmTree), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED) {
+            if (old->magic == SHM_TREE_MAGIC) atomic_store(&old->closed, 1);
+            munmap(old, sizeof(ShmTree));
+        }
+    }
+    close(fd);
+}
+
+// Create the shared segment, replacing a stale one, with an empty root cube.
+// Only the daemon's user may map it.
+ShmTree *createShmTree(const char *name, int capacity) {
+    closeOldShmTree(name);
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        perror("Failed to create shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+    if (ftruncate(fd, segmentSize(capacity)) == -1) {
+        perror("Failed to size shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+    ShmTree *t = (ShmTree *)mmap(NULL, segmentSize(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t == MAP_FAILED) {
+        perror("Failed to map shared memory segment");
+        exit(EXIT_FAILURE);
+    }
+
+    t->magic = SHM_TREE_MAGIC;
+    atomic_store(&t->sequence, 0);
+    atomic_store(&t->closed, 0);
+    t->owner = getpid();
+    t->capacity = capacity;
+    t->used = 1;
+    t->freeGroup = -1;
+    t->freeGroups = 0;
+    t->points = 0;
+    ShmNode *root = &t->nodes[0];
+    memset(root, 0, sizeof(ShmNode));
+    root->size = MAX_SIZE;
+    root->isLeaf = 1;
+    root->children = -1;
+    return t;
+}
+
+// Readers that start now wait or retry until endShmWrite()
+void beginShmWrite(ShmTree *t) {
+    atomic_fetch_add_explicit(&t->sequence, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void endShmWrite(ShmTree *t) {
+    atomic_fetch_add_explicit(&t->sequence, 1, memory_order_release);
+}
+
+// Hand out eight consecutive nodes, or -1 if the segment is full
+static int allocGroup(ShmTree *t) {
+    int group;
+    if (t->freeGroup != -1) {
+        group = t->freeGroup;
+        t->freeGroup = t->nodes[group].children;
+        t->freeGroups--;
+    } else if (t->used + 8 <= t->capacity) {
+        group = t->used;
+        t->used += 8;
+    } else {
+        return -1;
+    }
+    for (int i = 0; i < 8; i++) {
+        t->nodes[group + i].version = 0;   // Never equal to a real stamp, so the node gets copied
+        t->nodes[group + i].children = -1;
+        t->nodes[group + i].isLeaf = 1;
+        t->nodes[group + i].ptCount = 0;
+    }
+    return group;
+}
+
+// Put a group of eight and everything below it on the free list
+static void releaseGroup(ShmTree *t, int group) {
+    for (int i = 0; i < 8; i++) {
+        if (t->nodes[group + i].children != -1) releaseGroup(t, t->nodes[group + i].children);
+    }
+    t->nodes[group].children = t->freeGroup;
+    t->freeGroup = group;
+    t->freeGroups++;
+}
+
+// Copy node into the shared node at index. Every change to the tree renews the
+// stamps on the path it walks, so subtrees with an unchanged stamp are skipped.
+static bool syncNode(ShmTree *t, int index, OctreeNode *node) {
+    ShmNode *s = &t->nodes[index];
+    if (s->version == node->version) return true;
+
+    s->center = node->center;
+    s->size = node->size;
+    s->depth = node->depth;
+    if (node->isLeaf) {
+        if (s->children != -1) {
+            releaseGroup(t, s->children);
+            s->children = -1;
+        }
+        for (int j = 0; j < node->ptCount; j++) s->points[j] = node->points[j];
+        s->ptCount = node->ptCount;
+        s->isLeaf = 1;
+    } else {
+        if (s->children == -1) {
+            int group = allocGroup(t);
+            if (group == -1) return false;
+            s->children = group;
+        }
+        s->ptCount = 0;
+        s->isLeaf = 0;
+        bool complete = true;
+        for (int i = 0; i < 8; i++) {
+            if (!syncNode(t, s->children + i, node->children[i])) complete = false;
+        }
+        if (!complete) return false;   // Left stale so the next sync tries again
+    }
+    s->version = node->version;
+    return true;
+}
+
+// Bring the shared copy up to date with the tree; call between beginShmWrite() and
+// endShmWrite(). False if the segment ran out of nodes.
+bool syncShmTree(ShmTree *t, OctreeNode *root) {
+    return syncNode(t, 0, root);
+}
+
+// Nodes still available for subdivisions
+int shmFreeNodes(ShmTree *t) {
+    return t->capacity - t->used + 8 * t->freeGroups;
+}
+
+void destroyShmTree(ShmTree *t, const char *name) {
+    atomic_store(&t->closed, 1);
+    munmap(t, segmentSize(t->capacity));
+    shm_unlink(name);
+}
+
+// Map an existing segment read-only; NULL if there is none
+ShmTree *attachShmTree(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) return NULL;
+    ShmTree *header = (ShmTree *)mmap(NULL, sizeof(ShmTree), PROT_READ, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    int capacity = header->capacity;
+    bool valid = header->magic == SHM_TREE_MAGIC;
+    munmap(header, sizeof(ShmTree));
+
+    ShmTree *t = valid ? (ShmTree *)mmap(NULL, segmentSize(capacity), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    return t == MAP_FAILED ? NULL : t;
+}
+
+void detachShmTree(ShmTree *t) {
+    if (t) munmap(t, segmentSize(t->capacity));
+}
+
+// A daemon that died in the middle of a write never makes sequence even again
+static bool ownerAlive(ShmTree *t) {
+    return kill(t->owner, 0) == 0 || errno != ESRCH;
+}
+
+// Wait until no write is in progress and get the sequence to check against.
+// False if the segment is closed or its daemon is gone.
+static bool readBegin(ShmTree *t, unsigned int *s) {
+    for (int spins = 1; ; spins++) {
+        if (atomic_load_explicit(&t->closed, memory_order_acquire)) return false;
+        *s = atomic_load_explicit(&t->sequence, memory_order_acquire);
+        if (!(*s & 1)) return true;
+        if (spins % SHM_SPIN_CHECK == 0 && !ownerAlive(t)) return false;
+        sched_yield();
+    }
+}
+
+// Check if a write started since readBegin(), making what was read unusable
+static bool readRetry(ShmTree *t, unsigned int s) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&t->sequence, memory_order_relaxed) != s;
+}
+
+// A reader may see a node while it is being rewritten, so indices and counts are
+// checked before use; whatever it read is thrown away by readRetry() anyway
+static int childIndex(ShmTree *t, ShmNode *node) {
+    int c = node->children;
+    return (node->isLeaf || c < 1 || c > t->capacity - 8) ? -1 : c;
+}
+
+static int pointCount(ShmNode *node) {
+    return node->ptCount < 0 ? 0 : (node->ptCount > MAX_POINTS ? MAX_POINTS : node->ptCount);
+}
+
+// Same as getOctant(), repeated so the worker library does not need octree.c
+static int octantOf(Point *center, Point *p) {
+    return (p->x >= center->x ? 4 : 0) | (p->y >= center->y ? 2 : 0) | (p->z >= center->z ? 1 : 0);
+}
+
+static bool samePoint(Point *a, Point *b) {
+    return a->x == b->x && a->y == b->y && a->z == b->z;
+}
+
+int shmPointCount(ShmTree *t) {
+    unsigned int s;
+    int points;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        points = t->points;
+    } while (readRetry(t, s));
+    return points;
+}
+
+// Sequence of the segment's contents, renewed by every write; results read while it
+// stays the same are still current, so workers can cache them
+long shmSequence(ShmTree *t) {
+    unsigned int s;
+    if (!readBegin(t, &s)) return SHM_TREE_GONE;
+    return (long)s;
+}
+
+int shmSearch(ShmTree *t, Point *point) {
+    unsigned int s;
+    bool found;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        found = false;
+        ShmNode *node = &t->nodes[0];
+        for (int level = 0; level <= MAX_DEPTH; level++) {
+            int c = childIndex(t, node);
+            if (c == -1) break;
+            node = &t->nodes[c + octantOf(&node->center, point)];
+        }
+        int count = pointCount(node);
+        for (int j = 0; j < count && !found; j++) found = samePoint(&node->points[j], point);
+    } while (readRetry(t, s));
+    return found ? 1 : 0;
+}
+
+static void rangeNode(ShmTree *t, ShmNode *node, int level, Point *min, Point *max, Point *out, int maxOut, int *count) {
+    if (level > MAX_DEPTH) return;
+    if (node->center.x + node->size < min->x || node->center.x - node->size > max->x ||
+        node->center.y + node->size < min->y || node->center.y - node->size > max->y ||
+        node->center.z + node->size < min->z || node->center.z - node->size > max->z) {
+        return;
+    }
+    int c = childIndex(t, node);
+    if (c == -1) {
+        int n = pointCount(node);
+        for (int j = 0; j < n; j++) {
+            Point *p = &node->points[j];
+            if (p->x >= min->x && p->x <= max->x && p->y >= min->y && p->y <= max->y && p->z >= min->z && p->z <= max->z) {
+                if (*count < maxOut) out[*count] = *p;
+                (*count)++;
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < 8; i++) rangeNode(t, &t->nodes[c + i], level + 1, min, max, out, maxOut, count);
+}
+
+// Points with min <= p <= max on every axis, as countPointsInCube. The first maxOut
+// are written to out; returns how many there are in total.
+int shmRangeQuery(ShmTree *t, Point *min, Point *max, Point *out, int maxOut) {
+    unsigned int s;
+    int count;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        count = 0;
+        rangeNode(t, &t->nodes[0], 0, min, max, out, maxOut, &count);
+    } while (readRetry(t, s));
+    return count;
+}
+
+static float squaredDistance(Point *a, Point *b) {
+    float dx = a->x - b->x;
+    float dy = a->y - b->y;
+    float dz = a->z - b->z;
+    return dx*dx + dy*dy + dz*dz;
+}
+
+static float distanceToNodeSquared(Point *p, ShmNode *node) {
+    float d[3] = {0.0f, 0.0f, 0.0f};
+    float v[3] = {p->x, p->y, p->z};
+    float c[3] = {node->center.x, node->center.y, node->center.z};
+    for (int a = 0; a < 3; a++) {
+        if (v[a] < c[a] - node->size) d[a] = c[a] - node->size - v[a];
+        else if (v[a] > c[a] + node->size) d[a] = v[a] - (c[a] + node->size);
+    }
+    return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+}
+
+static void radiusNode(ShmTree *t, ShmNode *node, int level, Point *center, float radiusSquared, Point *out, int maxOut, int *count) {
+    if (level > MAX_DEPTH || distanceToNodeSquared(center, node) > radiusSquared) return;
+    int c = childIndex(t, node);
+    if (c == -1) {
+        int n = pointCount(node);
+        for (int j = 0; j < n; j++) {
+            if (squaredDistance(center, &node->points[j]) <= radiusSquared) {
+                if (*count < maxOut) out[*count] = node->points[j];
+                (*count)++;
+            }
+        }
+        return;
+    }
+    for (int i = 0; i < 8; i++) radiusNode(t, &t->nodes[c + i], level + 1, center, radiusSquared, out, maxOut, count);
+}
+
+// Points at a distance of at most radius from center, as countPointsInRadius
+int shmRadiusQuery(ShmTree *t, Point *center, float radius, Point *out, int maxOut) {
+    unsigned int s;
+    int count;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        count = 0;
+        radiusNode(t, &t->nodes[0], 0, center, radius * radius, out, maxOut, &count);
+    } while (readRetry(t, s));
+    return count;
+}
+
+static bool nearestNode(ShmTree *t, ShmNode *node, int level, Point *target, bool skipTarget, Point *nearest, float *minDist) {
+    if (level > MAX_DEPTH || distanceToNodeSquared(target, node) > *minDist) return false;
+
+    bool found = false;
+    int c = childIndex(t, node);
+    if (c == -1) {
+        int n = pointCount(node);
+        for (int j = 0; j < n; j++) {
+            float dist = squaredDistance(target, &node->points[j]);
+            if (dist < *minDist && !(skipTarget && dist == 0.0f)) {
+                *minDist = dist;
+                *nearest = node->points[j];
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    // Nearest children first, in the same order as findNearestNeighborHelper
+    int order[8];
+    float gap[8];
+    for (int i = 0; i < 8; i++) {
+        order[i] = i;
+        gap[i] = distanceToNodeSquared(target, &t->nodes[c + i]);
+    }
+    for (int i = 0; i < 7; i++) {
+        for (int j = i + 1; j < 8; j++) {
+            if (gap[order[i]] > gap[order[j]]) {
+                int swap = order[i];
+                order[i] = order[j];
+                order[j] = swap;
+            }
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        if (nearestNode(t, &t->nodes[c + order[i]], level + 1, target, skipTarget, nearest, minDist)) found = true;
+    }
+    return found;
+}
+
+// Nearest point to target, as findNearestNeighbor; with skipTarget unset a point
+// equal to target is a valid answer
+int shmNearestNeighbor(ShmTree *t, Point *target, bool skipTarget, Point *nearest, float *dist) {
+    unsigned int s;
+    bool found;
+    float minDist;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        minDist = FLT_MAX;
+        found = nearestNode(t, &t->nodes[0], 0, target, skipTarget, nearest, &minDist);
+    } while (readRetry(t, s));
+    if (found) *dist = sqrtf(minDist);
+    return found ? 1 : 0;
+}
+
+// Consistent copy of the node array. Returns the number of nodes in use;
+// nothing is copied if that is more than maxNodes.
+int shmSnapshot(ShmTree *t, ShmNode *out, int maxNodes) {
+    unsigned int s;
+    int used;
+    do {
+        if (!readBegin(t, &s)) return SHM_TREE_GONE;
+        used = t->used;
+        if (used >= 1 && used <= maxNodes && used <= t->capacity) memcpy(out, t->nodes, used * sizeof(ShmNode));
+    } while (readRetry(t, s));
+    return used;
+}
+
+// Size of ShmNode, so bindings from other languages can check their layout
+int shmNodeSize(void) {
+    return (int)sizeof(ShmNode);
+}
@@ -0,0 +1,70 @@
+// shm_tree.h
+#ifndef SHM_TREE_H
+#define SHM_TREE_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "octree.h"
+
+// Define constants
+#define SHM_TREE_NAME "/octree_shm"   // Default shared memory segment
+#define SHM_TREE_NODES 262144         // Nodes the segment has room for
+#define SHM_TREE_MAGIC 0x4f435453u
+#define SHM_TREE_GONE -1              // Query result once the segment was closed or its daemon died
+#define SHM_SPIN_CHECK 1024           // Waits on a write after which a reader checks that the daemon lives
+
+// Node of the shared tree. Children are referred to by index because every
+// process maps the segment at its own address; the eight children of a node
+// are stored next to each other.
+typedef struct ShmNode {
+    Point center;
+    float size;
+    int depth;
+    int isLeaf;
+    int ptCount;
+    int children;               // Index of the first child, -1 for a leaf
+    unsigned long version;      // Stamp of the OctreeNode this node was copied from
+    Point points[MAX_POINTS];
+} ShmNode;
+
+// Copy of an octree in a shared memory segment. Only the daemon writes it;
+// workers map it read-only and never take a lock. The daemon makes sequence
+// odd while it changes the tree and even again afterwards, and a reader
+// repeats its query if sequence was odd or changed meanwhile. The segment is
+// marked closed when its daemon exits or a new daemon replaces it; readers then
+// get SHM_TREE_GONE and must attach again.
+typedef struct ShmTree {
+    unsigned int magic;
+    atomic_uint sequence;
+    atomic_uint closed;
+    pid_t owner;                // Daemon writing the segment
+    int capacity;
+    int used;                   // Nodes handed out so far
+    int freeGroup;              // First node of a free group of eight, linked through children
+    int freeGroups;
+    int points;
+    ShmNode nodes[];
+} ShmTree;
+
+// Function prototypes
+// Daemon side
+ShmTree *createShmTree(const char *name, int capacity);
+void beginShmWrite(ShmTree *t);
+void endShmWrite(ShmTree *t);
+bool syncShmTree(ShmTree *t, OctreeNode *root);
+int shmFreeNodes(ShmTree *t);
+void destroyShmTree(ShmTree *t, const char *name);
+// Worker side, lock-free; every query returns SHM_TREE_GONE once the segment is closed
+ShmTree *attachShmTree(const char *name);
+void detachShmTree(ShmTree *t);
+int shmPointCount(ShmTree *t);
+long shmSequence(ShmTree *t);
+int shmSearch(ShmTree *t, Point *point);
+int shmRangeQuery(ShmTree *t, Point *min, Point *max, Point *out, int maxOut);
+int shmRadiusQuery(ShmTree *t, Point *center, float radius, Point *out, int maxOut);
+int shmNearestNeighbor(ShmTree *t, Point *target, bool skipTarget, Point *nearest, float *dist);
+int shmSnapshot(ShmTree *t, ShmNode *out, int maxNodes);
+int shmNodeSize(void);
+
+#endif // SHM_TREE_H
@@ -0,0 +1,161 @@
+// spatial_hash.c
+#include "spatial_hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Create an empty grid with the given cell size
+SpatialHash *createGrid(float cellSize) {
+    SpatialHash *grid = (SpatialHash *)calloc(1, sizeof(SpatialHash));
+    if (!grid) {
+        perror("Failed to allocate memory for spatial hash grid");
+        exit(EXIT_FAILURE);
+    }
+    grid->cellSize = cellSize;
+    grid->ptCount = 0;
+    return grid;
+}
+
+// Integer cell coordinate of a single axis value
+static int cellCoord(SpatialHash *grid, float v) {
+    return (int)floorf(v / grid->cellSize);
+}
+
+// Hash a cell to its bucket
+static GridBucket *bucketFor(SpatialHash *grid, int cx, int cy, int cz) {
+    unsigned int h = ((unsigned int)cx * 73856093u) ^
+                     ((unsigned int)cy * 19349663u) ^
+                     ((unsigned int)cz * 83492791u);
+    return &grid->buckets[h & (GRID_BUCKETS - 1)];
+}
+
+// Find the index of a point in a bucket, or -1
+static int findEntry(GridBucket *bucket, Point *point) {
+    for (int i = 0; i < bucket->count; i++) {
+        Point *q = &bucket->entries[i].point;
+        if (q->x == point->x && q->y == point->y && q->z == point->z) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Append an entry to a bucket, growing it when full
+static void appendEntry(GridBucket *bucket, Point *point, int cx, int cy, int cz) {
+    if (bucket->count == bucket->capacity) {
+        int newCapacity = bucket->capacity ? bucket->capacity * 2 : 4;
+        GridEntry *entries = (GridEntry *)realloc(bucket->entries, newCapacity * sizeof(GridEntry));
+        if (!entries) {
+            perror("Failed to grow spatial hash bucket");
+            exit(EXIT_FAILURE);
+        }
+        bucket->entries = entries;
+        bucket->capacity = newCapacity;
+    }
+    GridEntry *e = &bucket->entries[bucket->count++];
+    e->point = *point;
+    e->cx = cx; e->cy = cy; e->cz = cz;
+}
+
+// Search for a point in the grid
+bool gridSearchPoint(SpatialHash *grid, Point *point) {
+    int cx = cellCoord(grid, point->x), cy = cellCoord(grid, point->y), cz = cellCoord(grid, point->z);
+    return findEntry(bucketFor(grid, cx, cy, cz), point) != -1;
+}
+
+// Insert a point into the grid; like insertPoint() duplicates are not rejected
+bool gridInsertPoint(SpatialHash *grid, Point *point) {
+    int cx = cellCoord(grid, point->x), cy = cellCoord(grid, point->y), cz = cellCoord(grid, point->z);
+    appendEntry(bucketFor(grid, cx, cy, cz), point, cx, cy, cz);
+    grid->ptCount++;
+    return true;
+}
+
+// Delete a point from the grid, filling the gap with the bucket's last entry
+bool gridDeletePoint(SpatialHash *grid, Point *point) {
+    int cx = cellCoord(grid, point->x), cy = cellCoord(grid, point->y), cz = cellCoord(grid, point->z);
+    GridBucket *bucket = bucketFor(grid, cx, cy, cz);
+    int index = findEntry(bucket, point);
+    if (index == -1) return false;
+    bucket->entries[index] = bucket->entries[--bucket->count];
+    grid->ptCount--;
+    return true;
+}
+
+// Move a point; stays in place when the cell is unchanged, otherwise O(1) re-bucketing
+bool gridUpdatePoint(SpatialHash *grid, Point *oldPoint, Point *newPoint) {
+    int ox = cellCoord(grid, oldPoint->x), oy = cellCoord(grid, oldPoint->y), oz = cellCoord(grid, oldPoint->z);
+    GridBucket *bucket = bucketFor(grid, ox, oy, oz);
+    int index = findEntry(bucket, oldPoint);
+    if (index == -1) return false;
+
+    int nx = cellCoord(grid, newPoint->x), ny = cellCoord(grid, newPoint->y), nz = cellCoord(grid, newPoint->z);
+    if (nx == ox && ny == oy && nz == oz) {
+        bucket->entries[index].point = *newPoint;
+        return true;
+    }
+    bucket->entries[index] = bucket->entries[--bucket->count];
+    appendEntry(bucketFor(grid, nx, ny, nz), newPoint, nx, ny, nz);
+    return true;
+}
+
+// Count points within a cube (inclusive), matching rangeQuery()
+int gridCountPointsInCube(SpatialHash *grid, Point *min, Point *max) {
+    int x0 = cellCoord(grid, min->x), x1 = cellCoord(grid, max->x);
+    int y0 = cellCoord(grid, min->y), y1 = cellCoord(grid, max->y);
+    int z0 = cellCoord(grid, min->z), z1 = cellCoord(grid, max->z);
+    int count = 0;
+
+    // Large boxes touch more cells than there are buckets, so scan the buckets directly
+    double cells = (double)(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+    if (cells > GRID_BUCKETS) {
+        for (int b = 0; b < GRID_BUCKETS; b++) {
+            GridBucket *bucket = &grid->buckets[b];
+            for (int i = 0; i < bucket->count; i++) {
+                Point *p = &bucket->entries[i].point;
+                if (p->x >= min->x && p->x <= max->x &&
+                    p->y >= min->y && p->y <= max->y &&
+                    p->z >= min->z && p->z <= max->z) {
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+
+    for (int cx = x0; cx <= x1; cx++) {
+        for (int cy = y0; cy <= y1; cy++) {
+            for (int cz = z0; cz <= z1; cz++) {
+                GridBucket *bucket = bucketFor(grid, cx, cy, cz);
+                for (int i = 0; i < bucket->count; i++) {
+                    GridEntry *e = &bucket->entries[i];
+                    if (e->cx != cx || e->cy != cy || e->cz != cz) continue;
+                    Point *p = &e->point;
+                    if (p->x >= min->x && p->x <= max->x &&
+                        p->y >= min->y && p->y <= max->y &&
+                        p->z >= min->z && p->z <= max->z) {
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// Detect collision by checking the neighbouring cells, same box semantics as detect_collision()
+bool gridDetectCollision(SpatialHash *grid, Point moving_point, float box_size) {
+    Point min = { moving_point.x - box_size, moving_point.y - box_size, moving_point.z - box_size };
+    Point max = { moving_point.x + box_size, moving_point.y + box_size, moving_point.z + box_size };
+    return gridCountPointsInCube(grid, &min, &max) > 0;
+}
+
+// Free all memory allocated for the grid
+void freeGrid(SpatialHash *grid) {
+    if (grid) {
+        for (int b = 0; b < GRID_BUCKETS; b++) {
+            free(grid->buckets[b].entries);
+        }
+        free(grid);
+    }
+}
@@ -0,0 +1,43 @@
+// spatial_hash.h
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <stdbool.h>
+#include "octree.h"
+
+// Define constants
+#define GRID_CELL_SIZE COLLISION_SIZE  // Cell edge matches the collision box so a query touches 27 cells
+#define GRID_BUCKETS 4096              // Number of hash buckets (must be a power of two)
+
+// A point stored in the grid together with the cell it was hashed from
+typedef struct GridEntry {
+    Point point;
+    int cx, cy, cz;
+} GridEntry;
+
+// One hash bucket, a growable array of entries from every cell hashed to it
+typedef struct GridBucket {
+    GridEntry *entries;
+    int count;
+    int capacity;
+} GridBucket;
+
+// Uniform spatial-hash grid, an alternative backend to the octree for
+// uniformly spread, fast-moving points with a fixed collision size
+typedef struct SpatialHash {
+    float cellSize;
+    int ptCount;
+    GridBucket buckets[GRID_BUCKETS];
+} SpatialHash;
+
+// Function prototypes
+SpatialHash *createGrid(float cellSize);
+bool gridSearchPoint(SpatialHash *grid, Point *point);
+bool gridInsertPoint(SpatialHash *grid, Point *point);
+bool gridDeletePoint(SpatialHash *grid, Point *point);
+bool gridUpdatePoint(SpatialHash *grid, Point *oldPoint, Point *newPoint);
+int gridCountPointsInCube(SpatialHash *grid, Point *min, Point *max);
+bool gridDetectCollision(SpatialHash *grid, Point moving_point, float box_size);
+void freeGrid(SpatialHash *grid);
+
+#endif // SPATIAL_HASH_H
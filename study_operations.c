@@ -1,11 +1,23 @@
 #include "octree.h"
+#include "query_cache.h"
+#include "journal.h"
+#include "batch.h"
+#include "compaction.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <float.h>
 
 int main(){
     Point initialcenter = {0.0f, 0.0f, 0.0f};
     float size = MAX_SIZE;  // Arbitrary root size
-    OctreeNode *root = createNode(initialcenter, size, 0);
+    // Recover the tree from the last checkpoint and the journal, or start empty
+    OctreeNode *root;
+    Journal *journal = openJournal(JOURNAL_FILE, CHECKPOINT_FILE, JOURNAL_SYNC_EVERY, &root);
+    if (root == NULL) {
+        root = createNode(initialcenter, size, 0);
+    }
+    QueryCache *cache = createQueryCache();  // Repeated range and nearest queries are answered from here
+    Compactor *compactor = NULL;             // Compaction in progress, advanced by one slice per command
 
     //Take input query from user for insertion, deletion, search, range query, nearest neighbor search, print tree, free tree, collision detection
     char query;
@@ -25,7 +37,7 @@ int main(){
     }
 
     while (1) {
-        printf("Enter command (i: insert, d: delete, s: search, r: range query, n: nearest neighbor, q: quit): ");
+        printf("Enter command (i: insert, d: delete, s: search, r: range query, b: radius query, n: nearest neighbor, a: approximate nearest neighbor, p: print tree, m: metrics, o: compact, q: quit): ");
         scanf(" %c", &query);
         bool isChanged = true;
         switch (query) {
@@ -34,25 +46,32 @@ int main(){
                 int num_points;
                 printf("Enter number of points to insert: ");
                 scanf("%d", &num_points);
+                if (num_points <= 0) break;
+                BatchOp *ops = (BatchOp *)malloc(num_points * sizeof(BatchOp));
+                if (!ops) {
+                    perror("Failed to allocate memory for points");
+                    break;
+                }
                 for (int i = 0; i < num_points; i++) {
-                    Point *p = (Point *)malloc(sizeof(Point));
-                    if (!p) {
-                        perror("Failed to allocate memory for point");
-                        break;
-                    }
                     printf("Enter point to insert (x y z): ");
-                    scanf("%f %f %f", &p->x, &p->y, &p->z);
-    
-                    if (searchPoint(root, p) == NULL){
-                        insertPoint(root, p);    
-                        free(p); // Point is copied into the octree, free allocated memory
-                    } else{
+                    scanf("%f %f %f", &ops[i].point.x, &ops[i].point.y, &ops[i].point.z);
+                    ops[i].type = BATCH_INSERT;
+                }
+
+                // Insert all points in one pass over the tree
+                applyBatch(root, ops, num_points);
+                for (int i = 0; i < num_points; i++) {
+                    Point *p = &ops[i].point;
+                    if (ops[i].status == BATCH_DONE) {
+                        printf("Inserted point (%.2f, %.2f, %.2f)\n", p->x, p->y, p->z);
+                        journalAppend(journal, JOURNAL_INSERT, p, NULL);
+                    } else if (ops[i].status == BATCH_DUPLICATE) {
                         printf("Point (%.2f, %.2f, %.2f) already exists in the octree. Skipping duplicate.\n", p->x, p->y, p->z);
-                        free(p); // Free memory for duplicate point
+                    } else {
+                        printf("Max depth reached. Point (%.2f, %.2f, %.2f) not inserted.\n", p->x, p->y, p->z);
                     }
-                    free(p);
-                    printTree(root);
                 }
+                free(ops);
                 break;
             }
             case 'd': {
@@ -63,9 +82,13 @@ int main(){
                 }
                 printf("Enter point to delete (x y z): ");
                 scanf("%f %f %f", &p->x, &p->y, &p->z);
-                deletePoint(root, p);
+                if (searchPoint(root, p) != NULL) {
+                    deletePoint(root, p);
+                    journalAppend(journal, JOURNAL_DELETE, p, NULL);
+                } else {
+                    printf("Point (%.2f, %.2f, %.2f) not found in the octree.\n", p->x, p->y, p->z);
+                }
                 free(p);
-                printTree(root);
                 break;
             }
             case 's': {
@@ -83,7 +106,6 @@ int main(){
                     printf("Point (%.2f, %.2f, %.2f) not found in the octree.\n", p->x, p->y, p->z);
                 }
                 free(p);
-                printTree(root);
                 break;
             }
             case 'r': {
@@ -92,10 +114,12 @@ int main(){
                 scanf("%f %f %f", &min.x, &min.y, &min.z);
                 printf("Enter the maximum corner of the cube (x y z): ");
                 scanf("%f %f %f", &max.x, &max.y, &max.z);
-                int count = 0;
-                rangeQuery(root, &min, &max, &count, fp);
+                Point *results;
+                int count = cachedRangeQuery(cache, root, &min, &max, &results);
+                for (int i = 0; i < count; i++) {
+                    fprintf(fp, "Point within cube: (%.2f, %.2f, %.2f)\n", results[i].x, results[i].y, results[i].z);
+                }
                 printf("Total points within the cube: %d\n", count);
-                printTree(root);
                 break;
             }
             case 'n': {
@@ -103,18 +127,79 @@ int main(){
                 float minDist = MAX_SIZE * MAX_SIZE * 3;  // Initialize to maximum possible distance
                 printf("Enter target point (x y z): ");
                 scanf("%f %f %f", &target.x, &target.y, &target.z);
-                if (findNearestNeighbor(root, target, &nearest, &minDist)) {
+                if (cachedNearestNeighbor(cache, root, target, &nearest, &minDist)) {
                     printf("Nearest neighbor to (%.2f, %.2f, %.2f) is (%.2f, %.2f, %.2f) with distance %.2f\n",
                            target.x, target.y, target.z, nearest.x, nearest.y, nearest.z, minDist);
                 } else {
                     printf("No points found in the octree.\n");
                 }
+                break;
+            }
+            case 'b': {
+                Point center;
+                float radius;
+                printf("Enter the center of the sphere (x y z): ");
+                scanf("%f %f %f", &center.x, &center.y, &center.z);
+                printf("Enter the radius: ");
+                scanf("%f", &radius);
+                int count = 0;
+                radiusQuery(root, &center, radius, &count, fp);
+                printf("Total points within the sphere: %d\n", count);
+                break;
+            }
+            case 'a': {
+                Point target, nearest;
+                float epsilon, maxDist, minDist;
+                printf("Enter target point (x y z): ");
+                scanf("%f %f %f", &target.x, &target.y, &target.z);
+                printf("Enter epsilon and maximum distance (0 for no limit): ");
+                scanf("%f %f", &epsilon, &maxDist);
+                if (findApproxNearestNeighbor(root, target, maxDist > 0 ? maxDist : FLT_MAX, epsilon, &nearest, &minDist)) {
+                    printf("Approximate nearest neighbor to (%.2f, %.2f, %.2f) is (%.2f, %.2f, %.2f) with distance %.2f\n",
+                           target.x, target.y, target.z, nearest.x, nearest.y, nearest.z, minDist);
+                } else {
+                    printf("No points found within the maximum distance.\n");
+                }
+                break;
+            }
+            case 'p':
                 printTree(root);
+                printf("Octree structure has been written to Octree.txt\n");
+                break;
+            case 'm': {
+                TreeMetrics metrics;
+                measureTree(root, &metrics);
+                printTreeMetrics(&metrics, stdout);
+                if (compactionDue(&metrics)) printf("Compaction is advised (o).\n");
                 break;
             }
-            case 'q': return 0;
+            case 'o':
+                if (compactor == NULL) {
+                    compactor = createCompactor(root);
+                    printf("Compaction started, it advances by %d nodes after every command.\n", COMPACT_SLICE_NODES);
+                }
+                break;
+            case 'q':
+                freeCompactor(compactor);
+                journalCheckpoint(journal, root);
+                closeJournal(journal);
+                printTree(root);
+                freeQueryCache(cache);
+                return 0;
             default: printf("Invalid command.\n"); continue;
         }
+
+        if (compactor != NULL && compactStep(compactor, COMPACT_SLICE_NODES)) {
+            printf("Compaction finished: %d nodes moved, %d subtrees merged.\n", compactor->moved, compactor->collapsed);
+            freeCompactor(compactor);
+            compactor = NULL;
+        }
+
+        // Mutations are persisted through the journal; the whole tree is only rewritten at checkpoints
+        if (journalCheckpointDue(journal)) {
+            journalCheckpoint(journal, root);
+            printTree(root);
+        }
     }
     fclose(fp);
 
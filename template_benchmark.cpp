@@ -0,0 +1,125 @@
+// template_benchmark.cpp
+#include "octree.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+// Define constants
+#define TEMPLATE_POINTS 20000   // Default number of points per coordinate type
+#define TEMPLATE_QUERIES 2000   // Default number of queries of each kind
+
+// Small deterministic generator so the C and template trees see the same data
+static unsigned int benchRand(unsigned int *state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 8) & 0xFFFFFF;
+}
+
+// Coordinate in [-MAX_SIZE, MAX_SIZE), rounded to an integer when integral is set
+static float benchCoord(unsigned int *state, bool integral) {
+    float v = -MAX_SIZE + 2.0f * MAX_SIZE * (benchRand(state) / (float)0x1000000);
+    return integral ? std::floor(v) : v;
+}
+
+static Point benchPoint(unsigned int *state, bool integral) {
+    Point p;
+    p.x = benchCoord(state, integral);
+    p.y = benchCoord(state, integral);
+    p.z = benchCoord(state, integral);
+    return p;
+}
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Run the same inserts, deletes and queries on a C tree and a template tree and count
+// every differing result. With integral set all coordinates, radii and distances are
+// whole numbers small enough to be exact in float, so double and int32 trees must agree too.
+template <typename Tree>
+static int compareWithC(const char *name, int n, int queries, float halfSize, bool integral, unsigned int seed) {
+    typedef typename Tree::Point TPoint;
+    typedef typename Tree::Distance TDistance;
+    typedef typename Tree::Coordinate TCoordinate;
+    unsigned int state = seed;
+    Point center = {0.0f, 0.0f, 0.0f};
+    OctreeNode *root = createNode(center, halfSize, 0);
+    Tree tree(Tree::fromCPoint(center), static_cast<TCoordinate>(halfSize));
+    int mismatches = tree.halfSize() == halfSize ? 0 : 1;
+
+    std::vector<Point> pts(n);
+    for (int i = 0; i < n; i++) {
+        pts[i] = benchPoint(&state, integral);
+        bool inC = searchPoint(root, &pts[i]) == NULL && insertPoint_collision(root, &pts[i]);
+        bool inTree = !tree.contains(Tree::fromCPoint(pts[i])) && tree.insert(Tree::fromCPoint(pts[i]));
+        if (inC != inTree) mismatches++;
+    }
+    for (int i = 0; i < n; i += 3) {
+        bool inC = searchPoint(root, &pts[i]) != NULL;
+        deletePoint_collision(root, &pts[i]);
+        if (tree.erase(Tree::fromCPoint(pts[i])) != inC) mismatches++;
+    }
+
+    double cMs = 0.0, treeMs = 0.0;
+    for (int q = 0; q < queries; q++) {
+        Point min = benchPoint(&state, integral);
+        float edge = integral ? (float)(benchRand(&state) % 200) : 200.0f * (benchRand(&state) / (float)0x1000000);
+        Point max = {min.x + edge, min.y + edge, min.z + edge};
+        double start = nowMs();
+        int inC = countPointsInCube(root, &min, &max);
+        cMs += nowMs() - start;
+        start = nowMs();
+        int inTree = tree.countInBox(Tree::fromCPoint(min), Tree::fromCPoint(max));
+        treeMs += nowMs() - start;
+        if (inC != inTree) mismatches++;
+
+        Point c = benchPoint(&state, integral);
+        if (countPointsInRadius(root, &c, edge) != tree.countInRadius(Tree::fromCPoint(c), static_cast<TCoordinate>(edge))) mismatches++;
+
+        Point nearestC;
+        float distC;
+        TPoint nearestTree;
+        TDistance distTree;
+        bool foundC = findNearestNeighbor(root, c, &nearestC, &distC);
+        bool foundTree = tree.nearest(Tree::fromCPoint(c), nearestTree, distTree);
+        if (foundC != foundTree || (foundC && Tree::fromCPoint(nearestC) != nearestTree)) mismatches++;
+    }
+
+    // Round trips through the C API keep every point
+    Point lo = {-halfSize, -halfSize, -halfSize};
+    Point hi = {halfSize, halfSize, halfSize};
+    OctreeNode *back = tree.toC();
+    if (countPointsInCube(back, &lo, &hi) != tree.size()) mismatches++;
+    Tree copy = Tree::fromC(root);
+    if (copy.size() != countPointsInCube(root, &lo, &hi)) mismatches++;
+    Tree moved = std::move(copy);
+    if (moved.countInBox(Tree::fromCPoint(lo), Tree::fromCPoint(hi)) != tree.size()) mismatches++;
+
+    printf("  %-7s %6d points   %s   %d box queries: C %7.2f ms, template %7.2f ms\n",
+           name, tree.size(), mismatches == 0 ? "identical " : "MISMATCH  ", queries, cMs, treeMs);
+    if (mismatches > 0) printf("  %d results of the %s tree differ from the C tree\n", mismatches, name);
+
+    freeTree(back);
+    freeTree(root);
+    return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : TEMPLATE_POINTS;
+    int queries = argc > 2 ? atoi(argv[2]) : TEMPLATE_QUERIES;
+    if (n <= 0 || queries < 0) {
+        fprintf(stderr, "Usage: %s [points] [queries]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("template octree against the C octree (inserts, deletes, box, radius and nearest queries)\n");
+    int mismatches = 0;
+    mismatches += compareWithC<octree::Octree<float>>("float", n, queries, MAX_SIZE, false, 101u);
+    mismatches += compareWithC<octree::Octree<double>>("double", n, queries, MAX_SIZE, true, 202u);
+    // Integer trees need a power of two root half size
+    mismatches += compareWithC<octree::Octree<int32_t>>("int32", n, queries, 1024.0f, true, 303u);
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}